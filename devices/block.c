@@ -135,6 +135,65 @@ block_write (struct block* block, block_sector_t sector, const void* buffer) {
 	block->write_cnt++;
 }
 
+/* Verifies that the CNT sectors starting at SECTOR all lie
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block* block, block_sector_t sector,
+               block_sector_t cnt) {
+	ASSERT (cnt > 0);
+	check_sector (block, sector);
+	check_sector (block, sector + cnt - 1);
+	if (sector + cnt - 1 < sector) {
+		PANIC ("Sector range wraps around on device %s", block_name (block));
+	}
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes.  Drivers that support it
+   transfer the whole range as one command sequence, which is
+   much cheaper than CNT calls to block_read().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block* block, block_sector_t sector,
+                     void* buffer, block_sector_t cnt) {
+	block_sector_t i;
+
+	check_sectors (block, sector, cnt);
+	if (block->ops->read_multiple != NULL) {
+		block->ops->read_multiple (block->aux, sector, buffer, cnt);
+	} else
+		for (i = 0; i < cnt; i++) {
+			block->ops->read (block->aux, sector + i,
+			                  (uint8_t*) buffer + i * BLOCK_SECTOR_SIZE);
+		}
+	block->read_cnt += cnt;
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to
+   BLOCK from BUFFER, which must contain
+   CNT * BLOCK_SECTOR_SIZE bytes.  Returns after the block device
+   has acknowledged receiving all of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block* block, block_sector_t sector,
+                      const void* buffer, block_sector_t cnt) {
+	block_sector_t i;
+
+	check_sectors (block, sector, cnt);
+	ASSERT (block->type != BLOCK_FOREIGN);
+	if (block->ops->write_multiple != NULL) {
+		block->ops->write_multiple (block->aux, sector, buffer, cnt);
+	} else
+		for (i = 0; i < cnt; i++) {
+			block->ops->write (block->aux, sector + i,
+			                   (const uint8_t*) buffer + i * BLOCK_SECTOR_SIZE);
+		}
+	block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block* block) {
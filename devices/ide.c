@@ -34,6 +34,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +50,16 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+
+/* Most sectors we ask a disk to move per interrupt in READ
+   MULTIPLE and WRITE MULTIPLE. */
+#define MAX_MULTIPLE 16
+
+/* Most sectors a single ATA command can transfer. */
+#define MAX_NSECT 256
 
 /* An ATA device. */
 struct ata_disk {
@@ -56,6 +67,8 @@ struct ata_disk {
 	struct channel* channel;    /* Channel that disk is attached to. */
 	int dev_no;                 /* Device 0 or 1 for master or slave. */
 	bool is_ata;                /* Is device an ATA disk? */
+	int multiple;               /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, or 0 if unsupported. */
 };
 
 /* An ATA channel (aka controller).
@@ -82,8 +95,9 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel*);
 static bool check_device_type (struct ata_disk*);
 static void identify_ata_device (struct ata_disk*);
+static void set_multiple_mode (struct ata_disk*, int multiple);
 
-static void select_sector (struct ata_disk*, block_sector_t);
+static void select_sector (struct ata_disk*, block_sector_t, int cnt);
 static void issue_pio_command (struct channel*, uint8_t command);
 static void input_sector (struct channel*, void*);
 static void output_sector (struct channel*, const void*);
@@ -130,6 +144,7 @@ ide_init (void) {
 			d->channel = c;
 			d->dev_no = dev_no;
 			d->is_ata = false;
+			d->multiple = 0;
 		}
 
 		/* Register interrupt handler. */
@@ -288,12 +303,45 @@ identify_ata_device (struct ata_disk* d) {
 		return;
 	}
 
+	/* Word 47 holds the most sectors the disk can move per
+	   interrupt with READ/WRITE MULTIPLE, or 0 if it can't. */
+	set_multiple_mode (d, *(uint16_t*) &id[47 * 2] & 0xff);
+
 	/* Register. */
 	block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
 	                        &ide_operations, d);
 	partition_scan (block);
 }
 
+/* Tries to enable READ/WRITE MULTIPLE on disk D with at most
+   MULTIPLE sectors per interrupt.  Sets D's multiple member to
+   the block size in effect, which is 0 if the disk refused. */
+static void
+set_multiple_mode (struct ata_disk* d, int multiple) {
+	struct channel* c = d->channel;
+
+	/* The block size must be a power of 2. */
+	if (multiple > MAX_MULTIPLE) {
+		multiple = MAX_MULTIPLE;
+	}
+	while ((multiple & (multiple - 1)) != 0) {
+		multiple &= multiple - 1;
+	}
+
+	d->multiple = 0;
+	if (multiple < 2) {
+		return;
+	}
+
+	select_device_wait (d);
+	outb (reg_nsect (c), multiple);
+	issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+	sema_down (&c->completion_wait);
+	if ((inb (reg_status (c)) & STA_ERR) == 0) {
+		d->multiple = multiple;
+	}
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -329,7 +377,7 @@ ide_read (void* d_, block_sector_t sec_no, void* buffer) {
 	struct ata_disk* d = d_;
 	struct channel* c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, 1);
 	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
 	sema_down (&c->completion_wait);
 	if (!wait_while_busy (d)) {
@@ -349,7 +397,7 @@ ide_write (void* d_, block_sector_t sec_no, const void* buffer) {
 	struct ata_disk* d = d_;
 	struct channel* c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, 1);
 	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
 	if (!wait_while_busy (d)) {
 		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -359,22 +407,103 @@ ide_write (void* d_, block_sector_t sec_no, const void* buffer) {
 	lock_release (&c->lock);
 }
 
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   The channel is locked once for the whole transfer.  Each
+   command moves up to MAX_NSECT sectors; with READ MULTIPLE the
+   disk interrupts once per D->multiple sectors instead of once
+   per sector. */
+static void
+ide_read_multiple (void* d_, block_sector_t sec_no, void* buffer,
+                   block_sector_t cnt) {
+	struct ata_disk* d = d_;
+	struct channel* c = d->channel;
+	uint8_t* p = buffer;
+	int per_intr = d->multiple > 0 ? d->multiple : 1;
+
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		int nsect = cnt < MAX_NSECT ? (int) cnt : MAX_NSECT;
+		int left;
+
+		select_sector (d, sec_no, nsect);
+		issue_pio_command (c, d->multiple > 0
+		                   ? CMD_READ_MULTIPLE : CMD_READ_SECTOR_RETRY);
+		for (left = nsect; left > 0; ) {
+			int n = left < per_intr ? left : per_intr;
+			sema_down (&c->completion_wait);
+			if (!wait_while_busy (d)) {
+				PANIC ("%s: disk read failed, sector=%"PRDSNu,
+				       d->name, sec_no + (nsect - left));
+			}
+			for (; n > 0; n--, left--, p += BLOCK_SECTOR_SIZE) {
+				input_sector (c, p);
+			}
+		}
+		sec_no += nsect;
+		cnt -= nsect;
+	}
+	lock_release (&c->lock);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving all of the
+   data.  Locks the channel once for the whole transfer, as
+   ide_read_multiple() does. */
+static void
+ide_write_multiple (void* d_, block_sector_t sec_no, const void* buffer,
+                    block_sector_t cnt) {
+	struct ata_disk* d = d_;
+	struct channel* c = d->channel;
+	const uint8_t* p = buffer;
+	int per_intr = d->multiple > 0 ? d->multiple : 1;
+
+	lock_acquire (&c->lock);
+	while (cnt > 0) {
+		int nsect = cnt < MAX_NSECT ? (int) cnt : MAX_NSECT;
+		int left;
+
+		select_sector (d, sec_no, nsect);
+		issue_pio_command (c, d->multiple > 0
+		                   ? CMD_WRITE_MULTIPLE : CMD_WRITE_SECTOR_RETRY);
+		for (left = nsect; left > 0; ) {
+			int n = left < per_intr ? left : per_intr;
+			if (!wait_while_busy (d)) {
+				PANIC ("%s: disk write failed, sector=%"PRDSNu,
+				       d->name, sec_no + (nsect - left));
+			}
+			for (; n > 0; n--, left--, p += BLOCK_SECTOR_SIZE) {
+				output_sector (c, p);
+			}
+			sema_down (&c->completion_wait);
+		}
+		sec_no += nsect;
+		cnt -= nsect;
+	}
+	lock_release (&c->lock);
+}
+
 static struct block_operations ide_operations = {
 	ide_read,
-	ide_write
+	ide_write,
+	ide_read_multiple,
+	ide_write_multiple
 };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO to the disk's sector selection registers and CNT,
+   which must be between 1 and MAX_NSECT, to its sector count
+   register.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk* d, block_sector_t sec_no) {
+select_sector (struct ata_disk* d, block_sector_t sec_no, int cnt) {
 	struct channel* c = d->channel;
 
 	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= MAX_NSECT);
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == MAX_NSECT ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -7,6 +7,7 @@
 #include "kernel/io.h"
 #include "kernel/thread.h"
 #include "kernel/exception.h"
+#include "kernel/syscall.h"
 #ifdef FILESYS
 #include "devices/block.h"
 #include "filesys/filesys.h"
@@ -119,5 +120,6 @@ print_stats (void) {
 	kbd_print_stats ();
 #ifdef USERPROG
 	exception_print_stats ();
+	syscall_print_stats ();
 #endif
 }
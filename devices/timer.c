@@ -24,7 +24,32 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Hierarchical timing wheel holding every pending struct timer.
+
+   Level 0 has one slot per tick for the next WHEEL_SLOTS ticks.
+   Each slot of level L covers WHEEL_SLOTS**L ticks, so the wheel
+   reaches WHEEL_SLOTS**WHEEL_LEVELS ticks ahead; timers further
+   out wait in the last slot of the top level.  When the low bits
+   of the tick wrap around to 0, the matching slot of the next
+   level up is emptied and its timers are added again, landing in
+   lower levels ("cascading").  Adding, cancelling and expiring a
+   timer are all O(1), and a tick with nothing due costs one empty
+   list check.
+
+   The wheel is only accessed with interrupts off. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+static int64_t wheel_next;      /* Next tick the wheel will process. */
+
 static intr_handler_func timer_interrupt;
+static void wheel_insert (struct timer*);
+static void wheel_cascade (int level);
+static void wheel_run (int64_t tick);
+static void wake_sleeper (void* thread);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -34,6 +59,14 @@ static void real_time_delay (int64_t num, int32_t denom);
    and registers the corresponding interrupt. */
 void
 timer_init (void) {
+	int level, slot;
+
+	for (level = 0; level < WHEEL_LEVELS; level++)
+		for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+			list_init (&wheel[level][slot]);
+		}
+	wheel_next = ticks + 1;
+
 	pit_configure_channel (0, 2, TIMER_FREQ);
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
@@ -80,16 +113,62 @@ timer_elapsed (int64_t then) {
 	return timer_ticks () - then;
 }
 
+/* Arranges for FUNC (AUX) to be called from the timer interrupt
+   TICKS timer ticks from now, or on the next tick if TICKS is 0
+   or less.  If PERIOD is positive, it is then called again every
+   PERIOD ticks until the timer is cancelled.  T must not already
+   be pending. */
+void
+timer_add (struct timer* t, int64_t ticks, int64_t period,
+           timer_func* func, void* aux) {
+	enum intr_level old_level;
+
+	ASSERT (t != NULL && func != NULL);
+	ASSERT (period >= 0);
+
+	old_level = intr_disable ();
+	ASSERT (!t->pending);
+	t->expires = timer_ticks () + (ticks > 0 ? ticks : 1);
+	t->period = period;
+	t->func = func;
+	t->aux = aux;
+	wheel_insert (t);
+	intr_set_level (old_level);
+}
+
+/* Stops T from running again.  Returns true if T was pending,
+   false if it had already run (and was one-shot) or had been
+   cancelled.  May be called from T's own callback. */
+bool
+timer_cancel (struct timer* t) {
+	enum intr_level old_level = intr_disable ();
+	bool pending = t->pending;
+
+	if (pending) {
+		list_remove (&t->elem);
+		t->pending = false;
+	}
+	intr_set_level (old_level);
+	return pending;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.  The thread blocks until a timer wakes it, so it
+   uses no CPU in the meantime. */
 void
 timer_sleep (int64_t ticks) {
-	int64_t start = timer_ticks ();
+	struct thread* cur = thread_current ();
+	enum intr_level old_level;
 
 	ASSERT (intr_get_level () == INTR_ON);
-	while (timer_elapsed (start) < ticks) {
-		thread_yield ();
+	if (ticks <= 0) {
+		return;
 	}
+
+	old_level = intr_disable ();
+	timer_add (&cur->sleep_timer, ticks, 0, wake_sleeper, cur);
+	thread_block ();
+	intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -155,13 +234,102 @@ timer_print_stats (void) {
 	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Runs the kernel timers that are
+   due, then lets the scheduler account for the tick. */
 static void
 timer_interrupt (struct intr_frame* args UNUSED) {
 	ticks++;
+	while (wheel_next <= ticks) {
+		wheel_run (wheel_next);
+		wheel_next++;
+	}
 	thread_tick ();
 }
 
+/* Puts pending timer T in the wheel slot for T->expires, relative
+   to wheel_next.  A timer that is already due goes in the slot
+   processed next. */
+static void
+wheel_insert (struct timer* t) {
+	int64_t expires = t->expires;
+	int64_t delta = expires - wheel_next;
+	int level;
+
+	if (delta < 0) {
+		expires = wheel_next;
+		delta = 0;
+	}
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1))) {
+			break;
+		}
+	if (delta >= (int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) {
+		/* Beyond the wheel: park in the furthest slot and try
+		   again when it cascades. */
+		expires = wheel_next + ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	}
+
+	list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK],
+	                &t->elem);
+	t->pending = true;
+}
+
+/* Re-inserts the timers in the slot of LEVEL that covers
+   wheel_next, which moves them down to lower levels. */
+static void
+wheel_cascade (int level) {
+	struct list* slot = &wheel[level][(wheel_next >> (WHEEL_BITS * level))
+	                                  & WHEEL_MASK];
+	struct list timers;
+
+	list_init (&timers);
+	while (!list_empty (slot)) {
+		list_push_back (&timers, list_pop_front (slot));
+	}
+	while (!list_empty (&timers)) {
+		wheel_insert (list_entry (list_pop_front (&timers), struct timer, elem));
+	}
+}
+
+/* Processes tick TICK, which must equal wheel_next: cascades the
+   higher levels where TICK starts a new slot, then runs every
+   timer in TICK's level 0 slot.  A periodic timer is added again
+   before its callback runs, so the callback may cancel it. */
+static void
+wheel_run (int64_t tick) {
+	struct list* slot = &wheel[0][tick & WHEEL_MASK];
+	int level;
+
+	ASSERT (tick == wheel_next);
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		if (((tick >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK) != 0) {
+			break;
+		}
+		wheel_cascade (level);
+	}
+
+	while (!list_empty (slot)) {
+		struct timer* t = list_entry (list_pop_front (slot), struct timer, elem);
+
+		ASSERT (t->expires <= tick);
+		t->pending = false;
+		if (t->period > 0) {
+			t->expires += t->period;
+			if (t->expires <= tick) {
+				t->expires = tick + 1;
+			}
+			wheel_insert (t);
+		}
+		t->func (t->aux);
+	}
+}
+
+/* Timer callback that ends a timer_sleep() of THREAD. */
+static void
+wake_sleeper (void* thread) {
+	thread_unblock (thread);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
@@ -1,18 +1,41 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* A kernel timer callback.  Runs in the timer interrupt handler,
+   with interrupts off, so it must not sleep. */
+typedef void timer_func (void* aux);
+
+/* A one-shot or periodic kernel timer.  The caller owns the
+   storage, which must be zeroed or have been passed to
+   timer_add() before it is first given to timer_cancel(). */
+struct timer {
+	struct list_elem elem;      /* Element in a timing wheel slot. */
+	int64_t expires;            /* Tick at which FUNC runs next. */
+	int64_t period;             /* Ticks between runs, 0 if one-shot. */
+	timer_func* func;           /* Callback. */
+	void* aux;                  /* Argument to FUNC. */
+	bool pending;               /* In the timing wheel? */
+};
+
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* Kernel timers. */
+void timer_add (struct timer*, int64_t ticks, int64_t period,
+                timer_func*, void* aux);
+bool timer_cancel (struct timer*);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -0,0 +1,79 @@
+/* sysstats.c
+
+   Prints system call statistics: how many times each system call
+   was made, the cycles spent in it, and a histogram of how long
+   the calls took.  With no arguments, reports on all processes
+   since boot.  With arguments, runs each one as a command first
+   and waits for it, then reports on the calls made while the
+   commands ran as well as the global totals.  The former are the
+   change in the global totals, so they include this program's
+   exec and wait calls and the calls of anything else running at
+   the same time. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+/* Most system calls to take a snapshot of. */
+#define MAX_SYSCALLS 64
+
+static void print_stats (const struct syscall_stats* before);
+
+int
+main (int argc, char* argv[]) {
+	static struct syscall_stats before[MAX_SYSCALLS];
+	int number, i;
+
+	if (argc > 1) {
+		for (number = 0; number < MAX_SYSCALLS; number++)
+			if (!sysstats (number, true, &before[number])) {
+				break;
+			}
+	}
+
+	for (i = 1; i < argc; i++) {
+		pid_t pid = exec (argv[i]);
+		if (pid == PID_ERROR) {
+			printf ("%s: exec failed\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+		wait (pid);
+	}
+
+	if (argc > 1) {
+		printf ("While the commands ran:\n");
+		print_stats (before);
+	}
+	printf ("All processes:\n");
+	print_stats (NULL);
+	return EXIT_SUCCESS;
+}
+
+/* Prints the statistics over all processes of every system call
+   that was made at least once, less the counts in BEFORE if it is
+   not null. */
+static void
+print_stats (const struct syscall_stats* before) {
+	struct syscall_stats stats;
+	int number, b;
+
+	for (number = 0; sysstats (number, true, &stats); number++) {
+		if (before != NULL && number < MAX_SYSCALLS) {
+			stats.call_cnt -= before[number].call_cnt;
+			stats.cycles -= before[number].cycles;
+			for (b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+				stats.hist[b] -= before[number].hist[b];
+			}
+		}
+		if (stats.call_cnt == 0) {
+			continue;
+		}
+		printf ("%-10s %8llu calls %12llu cycles ",
+		        stats.name, stats.call_cnt, stats.cycles);
+		for (b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+			if (stats.hist[b] != 0) {
+				printf (" %d:%u", b, stats.hist[b]);
+			}
+		}
+		printf ("\n");
+	}
+}
@@ -0,0 +1,361 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "kernel/synch.h"
+#include "kernel/thread.h"
+#include "devices/timer.h"
+
+/* How often the write-behind thread flushes dirty sectors. */
+#define WRITE_BEHIND_TICKS (TIMER_FREQ * 5)
+
+/* A cached sector.
+
+   SECTOR, PIN_CNT and ACCESSED are guarded by cache_lock.  DATA,
+   VALID and DIRTY are guarded by DATA_LOCK, except that an entry
+   with a zero PIN_CNT may be examined by whoever holds cache_lock,
+   since nobody can be holding its DATA_LOCK then. */
+struct cache_entry {
+	block_sector_t sector;              /* Cached sector, or CACHE_FREE. */
+	int pin_cnt;                        /* Threads using this entry. */
+	bool accessed;                      /* Used since the clock last passed? */
+	bool valid;                         /* Does DATA hold SECTOR's contents? */
+	bool dirty;                         /* Does DATA differ from the disk? */
+	struct lock data_lock;              /* Guards DATA during I/O and copies. */
+	uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+};
+
+/* Read-ahead requests waiting for the read-ahead thread.  A ring
+   buffer; requests that find it full are dropped. */
+#define READ_AHEAD_QUEUE 32
+static block_sector_t ra_queue[READ_AHEAD_QUEUE];
+
+/* Most consecutive sectors the read-ahead thread reads with one
+   disk request. */
+#define READ_AHEAD_BATCH 16
+static size_t ra_head, ra_cnt;          /* First request, number queued. */
+static struct lock ra_lock;             /* Guards the queue. */
+static struct condition ra_ready;       /* Signaled when a request is queued. */
+
+/* The write-behind timer ups write_behind_due every
+   WRITE_BEHIND_TICKS; the write-behind thread downs it and
+   flushes. */
+static struct timer write_behind_timer;
+static struct semaphore write_behind_due;
+
+/* SECTOR value of an unused entry. */
+#define CACHE_FREE ((block_sector_t) -1)
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;          /* Guards sector tags and pins. */
+static struct condition cache_unpinned; /* Signaled when an entry is unpinned. */
+static size_t clock_hand;               /* Next entry the clock looks at. */
+
+static struct cache_entry* cache_get (block_sector_t, bool overwrite);
+static struct cache_entry* cache_lookup (block_sector_t);
+static struct cache_entry* cache_alloc (block_sector_t);
+static struct cache_entry* cache_claim (block_sector_t);
+static void cache_put (struct cache_entry*);
+static struct cache_entry* cache_evict (void);
+static void write_behind (void* aux);
+static void write_behind_tick (void* aux);
+static void read_ahead (void* aux);
+
+/* Initializes the buffer cache and starts the write-behind
+   thread. */
+void
+cache_init (void) {
+	size_t i;
+
+	lock_init (&cache_lock);
+	cond_init (&cache_unpinned);
+	for (i = 0; i < CACHE_SIZE; i++) {
+		cache[i].sector = CACHE_FREE;
+		cache[i].pin_cnt = 0;
+		cache[i].accessed = false;
+		cache[i].valid = false;
+		cache[i].dirty = false;
+		lock_init (&cache[i].data_lock);
+	}
+	clock_hand = 0;
+	lock_init (&ra_lock);
+	cond_init (&ra_ready);
+	ra_head = ra_cnt = 0;
+	sema_init (&write_behind_due, 0);
+	thread_create ("write-behind", PRI_DEFAULT, write_behind, NULL);
+	timer_add (&write_behind_timer, WRITE_BEHIND_TICKS, WRITE_BEHIND_TICKS,
+	           write_behind_tick, NULL);
+	thread_create ("read-ahead", PRI_DEFAULT, read_ahead, NULL);
+}
+
+/* Reads all of SECTOR into BUFFER. */
+void
+cache_read (block_sector_t sector, void* buffer) {
+	cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes BUFFER over all of SECTOR. */
+void
+cache_write (block_sector_t sector, const void* buffer) {
+	cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Copies SIZE bytes starting at byte OFS of SECTOR into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void* buffer, off_t ofs, off_t size) {
+	struct cache_entry* e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+	e = cache_get (sector, false);
+	memcpy (buffer, e->data + ofs, size);
+	cache_put (e);
+}
+
+/* Copies SIZE bytes from BUFFER into SECTOR starting at byte
+   OFS.  The sector reaches the disk when it is evicted, when
+   the write-behind thread runs, or at cache_flush().  A write
+   that covers the whole sector does not read it first. */
+void
+cache_write_at (block_sector_t sector, const void* buffer, off_t ofs,
+                off_t size) {
+	struct cache_entry* e;
+
+	ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+	e = cache_get (sector, size == BLOCK_SECTOR_SIZE);
+	memcpy (e->data + ofs, buffer, size);
+	e->valid = true;
+	e->dirty = true;
+	cache_put (e);
+}
+
+/* Writes every dirty sector in the cache to disk. */
+void
+cache_flush (void) {
+	size_t i;
+
+	for (i = 0; i < CACHE_SIZE; i++) {
+		struct cache_entry* e = &cache[i];
+
+		lock_acquire (&cache_lock);
+		if (e->sector == CACHE_FREE) {
+			lock_release (&cache_lock);
+			continue;
+		}
+		e->pin_cnt++;
+		lock_release (&cache_lock);
+
+		lock_acquire (&e->data_lock);
+		if (e->valid && e->dirty) {
+			block_write (fs_device, e->sector, e->data);
+			e->dirty = false;
+		}
+		lock_release (&e->data_lock);
+
+		lock_acquire (&cache_lock);
+		e->pin_cnt--;
+		cond_signal (&cache_unpinned, &cache_lock);
+		lock_release (&cache_lock);
+	}
+}
+
+/* Asks the read-ahead thread to bring SECTOR into the cache, so
+   that a later read of it does not wait for the disk.  Does not
+   block; the request is dropped if too many are already
+   waiting. */
+void
+cache_read_ahead (block_sector_t sector) {
+	lock_acquire (&ra_lock);
+	if (ra_cnt < READ_AHEAD_QUEUE) {
+		ra_queue[(ra_head + ra_cnt++) % READ_AHEAD_QUEUE] = sector;
+		cond_signal (&ra_ready, &ra_lock);
+	}
+	lock_release (&ra_lock);
+}
+
+/* Returns the entry for SECTOR, pinned and with its data lock
+   held, reading the sector from disk if it was not cached.  If
+   OVERWRITE is true the caller is about to replace the whole
+   sector, so a missing sector is not read.  Release the entry
+   with cache_put(). */
+static struct cache_entry*
+cache_get (block_sector_t sector, bool overwrite) {
+	struct cache_entry* e;
+
+	lock_acquire (&cache_lock);
+	e = cache_lookup (sector);
+	if (e != NULL) {
+		e->pin_cnt++;
+		e->accessed = true;
+		lock_release (&cache_lock);
+		lock_acquire (&e->data_lock);
+	} else {
+		e = cache_alloc (sector);
+	}
+
+	if (!e->valid && !overwrite) {
+		block_read (fs_device, sector, e->data);
+		e->valid = true;
+	}
+	return e;
+}
+
+/* Returns the entry tagged with SECTOR, or a null pointer if
+   SECTOR is not cached.  cache_lock must be held. */
+static struct cache_entry*
+cache_lookup (block_sector_t sector) {
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+	for (i = 0; i < CACHE_SIZE; i++)
+		if (cache[i].sector == sector) {
+			return &cache[i];
+		}
+	return NULL;
+}
+
+/* Reuses an entry for SECTOR, which must not be cached, and
+   returns it pinned, with its data lock held and its data not
+   yet valid.  Must be called with cache_lock held, which it
+   releases.  The victim is unpinned, so nobody holds its data
+   lock and taking it here does not block.  Holding it before
+   SECTOR becomes visible keeps other threads from seeing the
+   entry until it is filled. */
+static struct cache_entry*
+cache_alloc (block_sector_t sector) {
+	struct cache_entry* e = cache_evict ();
+
+	e->sector = sector;
+	e->pin_cnt = 1;
+	e->accessed = true;
+	e->valid = false;
+	lock_acquire (&e->data_lock);
+	lock_release (&cache_lock);
+	return e;
+}
+
+/* Like cache_get (SECTOR, true), but returns a null pointer
+   instead if SECTOR is already cached.  The caller fills the
+   entry, marks it valid, and releases it with cache_put(). */
+static struct cache_entry*
+cache_claim (block_sector_t sector) {
+	lock_acquire (&cache_lock);
+	if (cache_lookup (sector) != NULL) {
+		lock_release (&cache_lock);
+		return NULL;
+	}
+	return cache_alloc (sector);
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void
+cache_put (struct cache_entry* e) {
+	lock_release (&e->data_lock);
+	lock_acquire (&cache_lock);
+	e->pin_cnt--;
+	cond_signal (&cache_unpinned, &cache_lock);
+	lock_release (&cache_lock);
+}
+
+/* Picks an unpinned entry to reuse with the clock algorithm,
+   writing it back first if it is dirty, and returns it.  The
+   write happens under cache_lock so that nobody can read the
+   old sector from disk before its new contents get there.
+   Waits if every entry is pinned.  cache_lock must be held. */
+static struct cache_entry*
+cache_evict (void) {
+	ASSERT (lock_held_by_current_thread (&cache_lock));
+
+	for (;;) {
+		size_t i;
+
+		/* Two sweeps: the first may only clear accessed bits. */
+		for (i = 0; i < 2 * CACHE_SIZE; i++) {
+			struct cache_entry* e = &cache[clock_hand];
+			clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+			if (e->pin_cnt > 0) {
+				continue;
+			}
+			if (e->accessed) {
+				e->accessed = false;
+				continue;
+			}
+			if (e->sector != CACHE_FREE && e->valid && e->dirty) {
+				block_write (fs_device, e->sector, e->data);
+			}
+			e->dirty = false;
+			return e;
+		}
+		cond_wait (&cache_unpinned, &cache_lock);
+	}
+}
+
+/* Write-behind thread.  Periodically flushes the cache so that
+   a crash loses at most a few seconds of writes.  The flush has
+   to sleep on locks and disk I/O, so it can't run in the timer
+   callback itself. */
+static void
+write_behind (void* aux UNUSED) {
+	for (;;) {
+		sema_down (&write_behind_due);
+		cache_flush ();
+	}
+}
+
+/* Write-behind timer callback.  Wakes the write-behind thread. */
+static void
+write_behind_tick (void* aux UNUSED) {
+	sema_up (&write_behind_due);
+}
+
+/* Read-ahead thread.  Loads the sectors queued by
+   cache_read_ahead() into the cache.  Requests for consecutive
+   sectors, which is what a sequential read queues, are taken
+   together, and each run of them that is not cached yet is read
+   with one block_read_multiple() into BUFFER and copied into its
+   entries.  A sector that is already cached costs only a
+   lookup. */
+static void
+read_ahead (void* aux UNUSED) {
+	static uint8_t buffer[READ_AHEAD_BATCH * BLOCK_SECTOR_SIZE];
+	struct cache_entry* run[READ_AHEAD_BATCH];
+
+	for (;;) {
+		block_sector_t first;
+		size_t cnt = 0;
+		size_t i, run_cnt, j;
+
+		lock_acquire (&ra_lock);
+		while (ra_cnt == 0) {
+			cond_wait (&ra_ready, &ra_lock);
+		}
+		first = ra_queue[ra_head];
+		do {
+			ra_head = (ra_head + 1) % READ_AHEAD_QUEUE;
+			ra_cnt--;
+			cnt++;
+		} while (ra_cnt > 0 && cnt < READ_AHEAD_BATCH
+		         && ra_queue[ra_head] == first + cnt);
+		lock_release (&ra_lock);
+
+		/* Each pass claims the uncached sectors from FIRST + I up to
+		   the next cached one, reads them, and skips the cached one. */
+		for (i = 0; i < cnt; i += run_cnt + 1) {
+			run_cnt = 0;
+			while (i + run_cnt < cnt
+			       && (run[run_cnt] = cache_claim (first + i + run_cnt)) != NULL) {
+				run_cnt++;
+			}
+			if (run_cnt == 0) {
+				continue;
+			}
+			block_read_multiple (fs_device, first + i, buffer, run_cnt);
+			for (j = 0; j < run_cnt; j++) {
+				memcpy (run[j]->data, buffer + j * BLOCK_SECTOR_SIZE,
+				        BLOCK_SECTOR_SIZE);
+				run[j]->valid = true;
+				cache_put (run[j]);
+			}
+		}
+	}
+}
@@ -2,9 +2,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "kernel/malloc.h"
+#include "kernel/synch.h"
 
 /* A directory. */
 struct dir {
@@ -19,11 +21,106 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* On-disk directory layout.
+
+   A directory is a hash table of names.  Its data is an array of
+   sector-sized blocks, the first DIR_BUCKETS of which are the
+   buckets; a name lives in bucket hash_string (name) %
+   DIR_BUCKETS, or in one of the overflow blocks chained from it
+   through NEXT.  Overflow blocks are appended to the end of the
+   directory as buckets fill up.  Buckets that were never written
+   are holes in the inode, which read back as empty blocks, so a
+   new directory takes no space beyond its inode. */
+#define DIR_BUCKETS 64
+#define DIR_BLOCK_ENTRIES \
+	((BLOCK_SECTOR_SIZE - sizeof (uint32_t)) / sizeof (struct dir_entry))
+
+struct dir_block {
+	uint32_t next;                      /* Next block in chain, 0 if none. */
+	struct dir_entry entries[DIR_BLOCK_ENTRIES];
+	uint8_t unused[BLOCK_SECTOR_SIZE - sizeof (uint32_t)
+	               - DIR_BLOCK_ENTRIES * sizeof (struct dir_entry)];
+};
+
+/* Returns the bucket that holds NAME. */
+static size_t
+dir_bucket (const char* name) {
+	return hash_string (name) % DIR_BUCKETS;
+}
+
+/* Reads block IDX of directory INODE into *B.  Returns false if
+   the directory has no such block. */
+static bool
+read_block (struct inode* inode, size_t idx, struct dir_block* b) {
+	return inode_read_at (inode, b, sizeof * b, idx * sizeof * b) == sizeof * b;
+}
+
+/* Returns the byte offset of entry SLOT of block IDX. */
+static off_t
+entry_ofs (size_t idx, size_t slot) {
+	return idx * sizeof (struct dir_block) + offsetof (struct dir_block, entries)
+	       + slot * sizeof (struct dir_entry);
+}
+
+/* Name cache ("dentry cache").  Maps a directory's inode number
+   and a name in it to the named inode's sector, so that walking
+   a path does not scan every directory on the way.  Holds at
+   most DCACHE_SIZE names, dropping the least recently used.
+   Only names that exist are cached, so adding a name needs no
+   invalidation; removing one does. */
+#define DCACHE_SIZE 256
+
+struct dentry {
+	block_sector_t parent;              /* Containing directory. */
+	char name[NAME_MAX + 1];            /* Name within PARENT. */
+	block_sector_t sector;              /* Named inode. */
+	struct hash_elem hash_elem;         /* Element in dcache. */
+	struct list_elem lru_elem;          /* Element in dcache_lru. */
+};
+
+static struct hash dcache;              /* All cached names. */
+static struct list dcache_lru;          /* Most recently used first. */
+static size_t dcache_cnt;               /* Number of cached names. */
+static struct lock dcache_lock;         /* Guards the above. */
+
+static unsigned dentry_hash (const struct hash_elem*, void* aux);
+static bool dentry_less (const struct hash_elem*, const struct hash_elem*,
+                         void* aux);
+static struct dentry* dcache_find (block_sector_t parent, const char* name);
+static bool dcache_lookup (block_sector_t parent, const char* name,
+                           block_sector_t* sectorp);
+static void dcache_insert (block_sector_t parent, const char* name,
+                           block_sector_t sector);
+static void dcache_remove (block_sector_t parent, const char* name);
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	hash_init (&dcache, dentry_hash, dentry_less, NULL);
+	list_init (&dcache_lru);
+	dcache_cnt = 0;
+	lock_init (&dcache_lock);
+}
+
+/* Creates an empty directory in the given SECTOR, inside the
+   directory whose inode is in sector PARENT.  Returns true if
+   successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt) {
-	return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+dir_create (block_sector_t sector, block_sector_t parent) {
+	struct inode* inode;
+
+	ASSERT (sizeof (struct dir_block) == BLOCK_SECTOR_SIZE);
+
+	if (!inode_create (sector, DIR_BUCKETS * sizeof (struct dir_block), true)) {
+		return false;
+	}
+	inode = inode_open (sector);
+	if (inode == NULL) {
+		return false;
+	}
+	inode_set_parent (inode, parent);
+	inode_close (inode);
+	return true;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -75,46 +172,76 @@ dir_get_inode (struct dir* dir) {
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   Only NAME's bucket chain is searched. */
 static bool
 lookup (const struct dir* dir, const char* name,
         struct dir_entry* ep, off_t* ofsp) {
-	struct dir_entry e;
-	size_t ofs;
+	struct dir_block b;
+	size_t idx, slot;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-	     ofs += sizeof e)
-		if (e.in_use && !strcmp (name, e.name)) {
-			if (ep != NULL) {
-				*ep = e;
+	for (idx = dir_bucket (name); read_block (dir->inode, idx, &b);
+	     idx = b.next) {
+		for (slot = 0; slot < DIR_BLOCK_ENTRIES; slot++) {
+			struct dir_entry* e = &b.entries[slot];
+			if (e->in_use && !strcmp (name, e->name)) {
+				if (ep != NULL) {
+					*ep = *e;
+				}
+				if (ofsp != NULL) {
+					*ofsp = entry_ofs (idx, slot);
+				}
+				return true;
 			}
-			if (ofsp != NULL) {
-				*ofsp = ofs;
-			}
-			return true;
 		}
+		if (b.next == 0) {
+			break;
+		}
+	}
 	return false;
 }
 
+/* Returns true if NAME is "." or "..". */
+static bool
+is_dot (const char* name) {
+	return !strcmp (name, ".") || !strcmp (name, "..");
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
+   "." names DIR itself and ".." its parent.
    On success, sets *INODE to an inode for the file, otherwise to
    a null pointer.  The caller must close *INODE. */
 bool
 dir_lookup (const struct dir* dir, const char* name,
             struct inode** inode) {
+	block_sector_t parent, sector;
 	struct dir_entry e;
 
 	ASSERT (dir != NULL);
 	ASSERT (name != NULL);
 
-	if (lookup (dir, name, &e, NULL)) {
-		*inode = inode_open (e.inode_sector);
+	parent = inode_get_inumber (dir->inode);
+	if (!strcmp (name, ".")) {
+		*inode = inode_reopen (dir->inode);
+	} else if (!strcmp (name, "..")) {
+		*inode = inode_open (inode_get_parent (dir->inode));
 	} else {
-		*inode = NULL;
+		/* Hold DIR's lock until the inode is open, so that it can't
+		   be removed and its sector reused in between. */
+		inode_lock_dir (dir->inode);
+		if (dcache_lookup (parent, name, &sector)) {
+			*inode = inode_open (sector);
+		} else if (lookup (dir, name, &e, NULL)) {
+			dcache_insert (parent, name, e.inode_sector);
+			*inode = inode_open (e.inode_sector);
+		} else {
+			*inode = NULL;
+		}
+		inode_unlock_dir (dir->inode);
 	}
 
 	return *inode != NULL;
@@ -124,11 +251,13 @@ dir_lookup (const struct dir* dir, const char* name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir* dir, const char* name, block_sector_t inode_sector) {
+	struct dir_block b;
 	struct dir_entry e;
+	size_t idx, slot;
 	off_t ofs;
 	bool success = false;
 
@@ -136,41 +265,80 @@ dir_add (struct dir* dir, const char* name, block_sector_t inode_sector) {
 	ASSERT (name != NULL);
 
 	/* Check NAME for validity. */
-	if (*name == '\0' || strlen (name) > NAME_MAX) {
+	if (*name == '\0' || strlen (name) > NAME_MAX || is_dot (name)) {
 		return false;
 	}
 
-	/* Check that NAME is not in use. */
-	if (lookup (dir, name, NULL, NULL)) {
+	/* Check that DIR is still there and NAME is not in use. */
+	inode_lock_dir (dir->inode);
+	if (inode_is_removed (dir->inode) || lookup (dir, name, NULL, NULL)) {
 		goto done;
 	}
 
-	/* Set OFS to offset of free slot.
-	   If there are no free slots, then it will be set to the
-	   current end-of-file.
+	/* Set OFS to offset of a free slot in NAME's bucket chain.
+	   If the chain is full, append an overflow block to the
+	   directory and link it to the end of the chain.
 
 	   inode_read_at() will only return a short read at end of file.
 	   Otherwise, we'd need to verify that we didn't get a short
 	   read due to something intermittent such as low memory. */
-	for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-	     ofs += sizeof e)
-		if (!e.in_use) {
+	ofs = -1;
+	for (idx = dir_bucket (name); read_block (dir->inode, idx, &b);
+	     idx = b.next) {
+		for (slot = 0; slot < DIR_BLOCK_ENTRIES; slot++)
+			if (!b.entries[slot].in_use) {
+				ofs = entry_ofs (idx, slot);
+				break;
+			}
+		if (ofs >= 0 || b.next == 0) {
 			break;
 		}
+	}
+	if (ofs < 0) {
+		uint32_t next = inode_length (dir->inode) / sizeof b;
+
+		memset (&b, 0, sizeof b);
+		if (inode_write_at (dir->inode, &b, sizeof b, next * sizeof b) != sizeof b
+		    || inode_write_at (dir->inode, &next, sizeof next, idx * sizeof b)
+		       != sizeof next) {
+			goto done;
+		}
+		ofs = entry_ofs (next, 0);
+	}
 
 	/* Write slot. */
 	e.in_use = true;
 	strlcpy (e.name, name, sizeof e.name);
 	e.inode_sector = inode_sector;
 	success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+	if (success) {
+		dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+	}
 
 done:
+	inode_unlock_dir (dir->inode);
 	return success;
 }
 
+/* Returns true if directory INODE has no entries. */
+static bool
+dir_is_empty (struct inode* inode) {
+	struct dir_block b;
+	size_t idx, slot;
+
+	for (idx = 0; read_block (inode, idx, &b); idx++)
+		for (slot = 0; slot < DIR_BLOCK_ENTRIES; slot++)
+			if (b.entries[slot].in_use) {
+				return false;
+			}
+	return true;
+}
+
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, or if NAME is a
+   directory that is not empty or that is open elsewhere
+   (including as some process's working directory). */
 bool
 dir_remove (struct dir* dir, const char* name) {
 	struct dir_entry e;
@@ -182,6 +350,10 @@ dir_remove (struct dir* dir, const char* name) {
 	ASSERT (name != NULL);
 
 	/* Find directory entry. */
+	if (is_dot (name)) {
+		return false;
+	}
+	inode_lock_dir (dir->inode);
 	if (!lookup (dir, name, &e, &ofs)) {
 		goto done;
 	}
@@ -192,11 +364,20 @@ dir_remove (struct dir* dir, const char* name) {
 		goto done;
 	}
 
+	/* Only remove directories that are empty and unused.  Nobody
+	   else has it open, and opening it takes DIR's lock, so it
+	   stays empty until it is gone. */
+	if (inode_is_dir (inode)
+	    && (inode_open_cnt (inode) > 1 || !dir_is_empty (inode))) {
+		goto done;
+	}
+
 	/* Erase directory entry. */
 	e.in_use = false;
 	if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) {
 		goto done;
 	}
+	dcache_remove (inode_get_inumber (dir->inode), name);
 
 	/* Remove inode. */
 	inode_remove (inode);
@@ -204,22 +385,131 @@ dir_remove (struct dir* dir, const char* name) {
 
 done:
 	inode_close (inode);
+	inode_unlock_dir (dir->inode);
 	return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Entries come back in hash order.
+   DIR's position counts entry slots. */
 bool
 dir_readdir (struct dir* dir, char name[NAME_MAX + 1]) {
 	struct dir_entry e;
-
-	while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
-		dir->pos += sizeof e;
+	bool found = false;
+
+	inode_lock_dir (dir->inode);
+	for (; !found && inode_read_at (dir->inode, &e, sizeof e,
+	                                entry_ofs (dir->pos / DIR_BLOCK_ENTRIES,
+	                                           dir->pos % DIR_BLOCK_ENTRIES))
+	                 == sizeof e;
+	     dir->pos++)
 		if (e.in_use) {
 			strlcpy (name, e.name, NAME_MAX + 1);
-			return true;
+			found = true;
 		}
+	inode_unlock_dir (dir->inode);
+	return found;
+}
+
+/* Hashes a dentry by directory and name. */
+static unsigned
+dentry_hash (const struct hash_elem* e, void* aux UNUSED) {
+	const struct dentry* d = hash_entry (e, struct dentry, hash_elem);
+	return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+/* Orders dentries by directory, then name. */
+static bool
+dentry_less (const struct hash_elem* a_, const struct hash_elem* b_,
+             void* aux UNUSED) {
+	const struct dentry* a = hash_entry (a_, struct dentry, hash_elem);
+	const struct dentry* b = hash_entry (b_, struct dentry, hash_elem);
+	if (a->parent != b->parent) {
+		return a->parent < b->parent;
 	}
-	return false;
+	return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the cached dentry for NAME in directory PARENT, or a
+   null pointer.  dcache_lock must be held. */
+static struct dentry*
+dcache_find (block_sector_t parent, const char* name) {
+	struct dentry key;
+	struct hash_elem* e;
+
+	key.parent = parent;
+	strlcpy (key.name, name, sizeof key.name);
+	e = hash_find (&dcache, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Looks up NAME in directory PARENT in the name cache.  If it is
+   there, stores the inode's sector in *SECTORP and returns
+   true. */
+static bool
+dcache_lookup (block_sector_t parent, const char* name,
+               block_sector_t* sectorp) {
+	struct dentry* d;
+
+	if (strlen (name) > NAME_MAX) {
+		return false;
+	}
+	lock_acquire (&dcache_lock);
+	d = dcache_find (parent, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+		list_push_front (&dcache_lru, &d->lru_elem);
+		*sectorp = d->sector;
+	}
+	lock_release (&dcache_lock);
+	return d != NULL;
+}
+
+/* Records that NAME in directory PARENT is the inode in SECTOR. */
+static void
+dcache_insert (block_sector_t parent, const char* name,
+               block_sector_t sector) {
+	struct dentry* d;
+
+	lock_acquire (&dcache_lock);
+	d = dcache_find (parent, name);
+	if (d != NULL) {
+		list_remove (&d->lru_elem);
+	} else {
+		if (dcache_cnt >= DCACHE_SIZE) {
+			/* Reuse the least recently used entry. */
+			d = list_entry (list_pop_back (&dcache_lru), struct dentry, lru_elem);
+			hash_delete (&dcache, &d->hash_elem);
+		} else {
+			d = malloc (sizeof * d);
+			if (d == NULL) {
+				lock_release (&dcache_lock);
+				return;
+			}
+			dcache_cnt++;
+		}
+		d->parent = parent;
+		strlcpy (d->name, name, sizeof d->name);
+		hash_insert (&dcache, &d->hash_elem);
+	}
+	d->sector = sector;
+	list_push_front (&dcache_lru, &d->lru_elem);
+	lock_release (&dcache_lock);
+}
+
+/* Forgets NAME in directory PARENT, if it is cached. */
+static void
+dcache_remove (block_sector_t parent, const char* name) {
+	struct dentry* d;
+
+	lock_acquire (&dcache_lock);
+	d = dcache_find (parent, name);
+	if (d != NULL) {
+		hash_delete (&dcache, &d->hash_elem);
+		list_remove (&d->lru_elem);
+		free (d);
+		dcache_cnt--;
+	}
+	lock_release (&dcache_lock);
 }
@@ -2,15 +2,19 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "kernel/malloc.h"
+#include "kernel/thread.h"
 
 /* Partition that contains the file system. */
 struct block* fs_device;
 
 static void do_format (void);
+static struct dir* open_parent (const char* path, char name[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,7 +25,9 @@ filesys_init (bool format) {
 		PANIC ("No file system device found, can't initialize file system.");
 	}
 
+	cache_init ();
 	inode_init ();
+	dir_init ();
 	free_map_init ();
 
 	if (format) {
@@ -36,20 +42,24 @@ filesys_init (bool format) {
 void
 filesys_done (void) {
 	free_map_close ();
+	cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
+   NAME may be a path, absolute or relative to the current
+   directory.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
    or if internal memory allocation fails. */
 bool
 filesys_create (const char* name, off_t initial_size) {
 	block_sector_t inode_sector = 0;
-	struct dir* dir = dir_open_root ();
+	char file_name[NAME_MAX + 1];
+	struct dir* dir = open_parent (name, file_name);
 	bool success = (dir != NULL
 	                && free_map_allocate (1, &inode_sector)
-	                && inode_create (inode_sector, initial_size)
-	                && dir_add (dir, name, inode_sector));
+	                && inode_create (inode_sector, initial_size, false)
+	                && dir_add (dir, file_name, inode_sector));
 	if (!success && inode_sector != 0) {
 		free_map_release (inode_sector, 1);
 	}
@@ -58,43 +68,149 @@ filesys_create (const char* name, off_t initial_size) {
 	return success;
 }
 
-/* Opens the file with the given NAME.
+/* Creates a directory named NAME, which may be a path.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char* name) {
+	block_sector_t inode_sector = 0;
+	char dir_name[NAME_MAX + 1];
+	struct dir* dir = open_parent (name, dir_name);
+	bool success = (dir != NULL
+	                && free_map_allocate (1, &inode_sector)
+	                && dir_create (inode_sector,
+	                               inode_get_inumber (dir_get_inode (dir)))
+	                && dir_add (dir, dir_name, inode_sector));
+	if (!success && inode_sector != 0) {
+		free_map_release (inode_sector, 1);
+	}
+	dir_close (dir);
+
+	return success;
+}
+
+/* Opens the file with the given NAME, which may be a path.
+   Directories may be opened too.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
    or if an internal memory allocation fails. */
 struct file*
 filesys_open (const char* name) {
-	struct dir* dir = dir_open_root ();
+	char file_name[NAME_MAX + 1];
+	struct dir* dir = open_parent (name, file_name);
 	struct inode* inode = NULL;
 
 	if (dir != NULL) {
-		dir_lookup (dir, name, &inode);
+		dir_lookup (dir, file_name, &inode);
 	}
 	dir_close (dir);
 
 	return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file named NAME, which may be a path.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if NAME is a directory
+   that is not empty or is in use, or if an internal memory
+   allocation fails. */
 bool
 filesys_remove (const char* name) {
-	struct dir* dir = dir_open_root ();
-	bool success = dir != NULL && dir_remove (dir, name);
+	char file_name[NAME_MAX + 1];
+	struct dir* dir = open_parent (name, file_name);
+	bool success = dir != NULL && dir_remove (dir, file_name);
 	dir_close (dir);
 
 	return success;
 }
-
+
+/* Makes the directory named NAME the current thread's working
+   directory.  Returns true if successful, false if NAME does not
+   exist or is not a directory. */
+bool
+filesys_chdir (const char* name) {
+	struct thread* t = thread_current ();
+	char dir_name[NAME_MAX + 1];
+	struct dir* dir = open_parent (name, dir_name);
+	struct inode* inode = NULL;
+
+	if (dir != NULL) {
+		dir_lookup (dir, dir_name, &inode);
+	}
+	dir_close (dir);
+
+	if (inode == NULL || !inode_is_dir (inode)) {
+		inode_close (inode);
+		return false;
+	}
+	dir_close (t->cwd);
+	t->cwd = dir_open (inode);
+	return t->cwd != NULL;
+}
+
+/* Opens the directory that contains the last component of PATH
+   and copies that component into NAME.  A relative PATH starts
+   from the current thread's working directory, or the root if it
+   has none.  A PATH with no components, such as "/", yields the
+   starting directory and the name ".".
+   Returns a null pointer if PATH is empty, if a directory on the
+   way does not exist, or if a component is longer than
+   NAME_MAX. */
+static struct dir*
+open_parent (const char* path, char name[NAME_MAX + 1]) {
+	struct thread* t = thread_current ();
+	char* copy, * token, * next, * save_ptr;
+	size_t size = strlen (path) + 1;
+	struct dir* dir;
+
+	if (*path == '\0') {
+		return NULL;
+	}
+	copy = malloc (size);
+	if (copy == NULL) {
+		return NULL;
+	}
+	strlcpy (copy, path, size);
+
+	if (*path == '/' || t->cwd == NULL) {
+		dir = dir_open_root ();
+	} else {
+		dir = dir_reopen (t->cwd);
+	}
+
+	strlcpy (name, ".", NAME_MAX + 1);
+	for (token = strtok_r (copy, "/", &save_ptr); dir != NULL && token != NULL;
+	     token = next) {
+		struct inode* inode;
+
+		next = strtok_r (NULL, "/", &save_ptr);
+		if (strlen (token) > NAME_MAX) {
+			dir_close (dir);
+			dir = NULL;
+		} else if (next == NULL) {
+			strlcpy (name, token, NAME_MAX + 1);
+		} else {
+			dir_lookup (dir, token, &inode);
+			dir_close (dir);
+			if (inode != NULL && inode_is_dir (inode)) {
+				dir = dir_open (inode);
+			} else {
+				inode_close (inode);
+				dir = NULL;
+			}
+		}
+	}
+	free (copy);
+	return dir;
+}
+
 /* Formats the file system. */
 static void
 do_format (void) {
 	printf ("Formatting file system...");
 	free_map_create ();
-	if (!dir_create (ROOT_DIR_SECTOR, 16)) {
+	if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR)) {
 		PANIC ("root directory creation failed");
 	}
 	free_map_close ();
@@ -4,9 +4,14 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "kernel/synch.h"
 
 static struct file* free_map_file;   /* Free map file. */
 static struct bitmap* free_map;      /* Free map, one bit per sector. */
+static block_sector_t next_fit;      /* Where the next search starts. */
+static struct lock free_map_lock;    /* Guards the free map and NEXT_FIT. */
+
+static bool free_map_save (block_sector_t, size_t);
 
 /* Initializes the free map. */
 void
@@ -17,34 +22,86 @@ free_map_init (void) {
 	}
 	bitmap_mark (free_map, FREE_MAP_SECTOR);
 	bitmap_mark (free_map, ROOT_DIR_SECTOR);
+	next_fit = ROOT_DIR_SECTOR + 1;
+	lock_init (&free_map_lock);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The search starts where the last one
+   ended (next fit), so consecutive allocations come out
+   consecutive on disk, and wraps around to the start of the disk.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available or if the free_map file could not be
+   written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t* sectorp) {
-	block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-	if (sector != BITMAP_ERROR
-	    && free_map_file != NULL
-	    && !bitmap_write (free_map, free_map_file)) {
-		bitmap_set_multiple (free_map, sector, cnt, false);
-		sector = BITMAP_ERROR;
+	block_sector_t sector;
+	bool success = false;
+
+	lock_acquire (&free_map_lock);
+	sector = bitmap_scan (free_map, next_fit, cnt, false);
+	if (sector == BITMAP_ERROR) {
+		sector = bitmap_scan (free_map, 0, cnt, false);
 	}
 	if (sector != BITMAP_ERROR) {
-		*sectorp = sector;
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		success = free_map_save (sector, cnt);
+		if (success) {
+			next_fit = sector + cnt;
+			*sectorp = sector;
+		} else {
+			bitmap_set_multiple (free_map, sector, cnt, false);
+		}
+	}
+	lock_release (&free_map_lock);
+	return success;
+}
+
+/* Like free_map_allocate(), but if the CNT sectors right after
+   PREV are free, takes those, so that a growing file stays
+   contiguous on disk. */
+bool
+free_map_allocate_after (block_sector_t prev, size_t cnt,
+                         block_sector_t* sectorp) {
+	block_sector_t sector = prev + 1;
+
+	lock_acquire (&free_map_lock);
+	if (sector + cnt <= bitmap_size (free_map)
+	    && bitmap_none (free_map, sector, cnt)) {
+		bitmap_set_multiple (free_map, sector, cnt, true);
+		if (free_map_save (sector, cnt)) {
+			next_fit = sector + cnt;
+			*sectorp = sector;
+			lock_release (&free_map_lock);
+			return true;
+		}
+		bitmap_set_multiple (free_map, sector, cnt, false);
 	}
-	return sector != BITMAP_ERROR;
+	lock_release (&free_map_lock);
+	return free_map_allocate (cnt, sectorp);
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt) {
+	lock_acquire (&free_map_lock);
 	ASSERT (bitmap_all (free_map, sector, cnt));
 	bitmap_set_multiple (free_map, sector, cnt, false);
-	bitmap_write (free_map, free_map_file);
+	free_map_save (sector, cnt);
+	lock_release (&free_map_lock);
+}
+
+/* Writes the bits for CNT sectors starting at SECTOR to the free
+   map file.  Only the bytes holding them are written, and those
+   go into the buffer cache, so an allocation costs no disk I/O
+   of its own.  Before the free map file is open there is nothing
+   to write to; free_map_create() writes the whole map later.
+   Returns false if the write fails.  free_map_lock must be
+   held. */
+static bool
+free_map_save (block_sector_t sector, size_t cnt) {
+	return free_map_file == NULL
+	       || bitmap_write_range (free_map, free_map_file, sector, cnt);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -69,16 +126,25 @@ free_map_close (void) {
    it. */
 void
 free_map_create (void) {
+	struct file* file;
+
 	/* Create inode. */
-	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map))) {
+	if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false)) {
 		PANIC ("free map creation failed");
 	}
 
-	/* Write bitmap to file. */
-	free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-	if (free_map_file == NULL) {
+	/* Write bitmap to file.  The first write allocates the file's
+	   own sectors, so do it before free_map_file is set, or each
+	   allocation would try to write the bitmap again.  The second
+	   write records those sectors as used. */
+	file = file_open (inode_open (FREE_MAP_SECTOR));
+	if (file == NULL) {
 		PANIC ("can't open free map");
 	}
+	if (!bitmap_write (free_map, file)) {
+		PANIC ("can't write free map");
+	}
+	free_map_file = file;
 	if (!bitmap_write (free_map, free_map_file)) {
 		PANIC ("can't write free map");
 	}
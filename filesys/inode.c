@@ -1,22 +1,43 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "kernel/malloc.h"
+#include "kernel/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of direct, and of per-index-block, sector pointers. */
+#define DIRECT_CNT 122
+#define INDEX_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Largest file an inode can describe, in bytes. */
+#define INODE_MAX_LENGTH \
+	((off_t) ((DIRECT_CNT + INDEX_CNT + INDEX_CNT * INDEX_CNT) \
+	          * BLOCK_SECTOR_SIZE))
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The first DIRECT_CNT data sectors are listed in DIRECT.  The
+   next INDEX_CNT are listed in the index block INDIRECT, and the
+   rest in the index blocks listed by the index block
+   DOUBLY_INDIRECT.  A pointer of 0 means nothing is allocated
+   there yet (sector 0 holds the free map inode, so it is never a
+   data sector); holes read as zeros. */
 struct inode_disk {
-	block_sector_t start;               /* First data sector. */
+	block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+	block_sector_t indirect;            /* Index block of data sectors. */
+	block_sector_t doubly_indirect;     /* Index block of index blocks. */
 	off_t length;                       /* File size in bytes. */
+	uint32_t is_dir;                    /* Nonzero if a directory. */
+	block_sector_t parent;              /* Parent directory, if a directory. */
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[125];               /* Not used. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -26,47 +47,160 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* Read-ahead window limits, in sectors. */
+#define READ_AHEAD_MIN 1
+#define READ_AHEAD_MAX 16
+
+/* In-memory inode.
+
+   ELEM, OPEN_CNT, REMOVED, DENY_WRITE_CNT and LOADING are guarded
+   by open_inodes_lock.  DATA, the index blocks and LAST_SECTOR are
+   guarded by RW: readers of the file's contents hold it shared,
+   and anything that allocates sectors or changes DATA holds it
+   exclusive.  The RA_* fields are only a guess about the access
+   pattern, so concurrent readers may update them unsynchronized.
+   DIR_LOCK serializes operations on the entries of a directory
+   (see directory.c). */
 struct inode {
-	struct list_elem elem;              /* Element in inode list. */
+	struct hash_elem elem;              /* Element in open_inodes. */
 	block_sector_t sector;              /* Sector number of disk location. */
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	bool loading;                       /* Still being read in by inode_open()? */
+	struct rwlock rw;                   /* Guards the file's data and layout. */
+	struct lock dir_lock;               /* Guards directory entries. */
+	block_sector_t last_sector;         /* Last sector allocated for this inode. */
+	off_t ra_next;                      /* Sector index a sequential read hits next. */
+	off_t ra_end;                       /* Sector indexes below this are queued. */
+	int ra_window;                      /* Sectors to read ahead, 0 if random. */
 	struct inode_disk data;             /* Inode content. */
 };
 
+/* Allocates a sector for INODE, zeroes it, and stores it in
+   *SECTORP.  The sector right after the one INODE allocated last
+   is preferred, so that a file written in order is laid out in
+   order.  The zeros only reach the cache; the disk sees the
+   sector when it is first written back.  Returns false if the
+   disk is full. */
+static bool
+allocate_zeroed (struct inode* inode, block_sector_t* sectorp) {
+	static char zeros[BLOCK_SECTOR_SIZE];
+
+	if (!free_map_allocate_after (inode->last_sector, 1, sectorp)) {
+		return false;
+	}
+	inode->last_sector = *sectorp;
+	cache_write (*sectorp, zeros);
+	return true;
+}
+
+/* Returns the sector in *SLOT, a pointer in INODE's on-disk
+   inode.  If it is 0 and CREATE is true, allocates a zeroed
+   sector for it first and writes the inode back.  Returns 0 if
+   the slot is empty or allocation fails. */
+static block_sector_t
+inode_slot (struct inode* inode, block_sector_t* slot, bool create) {
+	if (*slot == 0 && create && allocate_zeroed (inode, slot)) {
+		cache_write (inode->sector, &inode->data);
+	}
+	return *slot;
+}
+
+/* Returns pointer IDX of INODE's index block BLOCK, like
+   inode_slot().  INODE may be null if CREATE is false. */
+static block_sector_t
+index_slot (struct inode* inode, block_sector_t block, size_t idx,
+            bool create) {
+	block_sector_t sector;
+
+	cache_read_at (block, &sector, idx * sizeof sector, sizeof sector);
+	if (sector == 0 && create && allocate_zeroed (inode, &sector)) {
+		cache_write_at (block, &sector, idx * sizeof sector, sizeof sector);
+	}
+	return sector;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   within INODE.  If CREATE is true, allocates that sector, and
+   any index blocks on the way to it, if they do not exist yet.
+   Returns 0 if there is no such sector: POS is in a hole and
+   CREATE is false, POS is beyond INODE_MAX_LENGTH, or the disk
+   is full. */
 static block_sector_t
-byte_to_sector (const struct inode* inode, off_t pos) {
+byte_to_sector (struct inode* inode, off_t pos, bool create) {
+	size_t idx = pos / BLOCK_SECTOR_SIZE;
+	block_sector_t block;
+
 	ASSERT (inode != NULL);
-	if (pos < inode->data.length) {
-		return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-	} else {
-		return -1;
+	if (idx < DIRECT_CNT) {
+		return inode_slot (inode, &inode->data.direct[idx], create);
+	}
+	idx -= DIRECT_CNT;
+	if (idx < INDEX_CNT) {
+		block = inode_slot (inode, &inode->data.indirect, create);
+		return block != 0 ? index_slot (inode, block, idx, create) : 0;
+	}
+	idx -= INDEX_CNT;
+	if (idx < INDEX_CNT * INDEX_CNT) {
+		block = inode_slot (inode, &inode->data.doubly_indirect, create);
+		if (block != 0) {
+			block = index_slot (inode, block, idx / INDEX_CNT, create);
+		}
+		return block != 0 ? index_slot (inode, block, idx % INDEX_CNT, create)
+		       : 0;
+	}
+	return 0;
+}
+
+/* Releases SECTOR, and if LEVEL is positive, the sectors its
+   pointers lead to, LEVEL index blocks deep.  Does nothing if
+   SECTOR is 0. */
+static void
+release_sectors (block_sector_t sector, int level) {
+	if (sector == 0) {
+		return;
+	}
+	if (level > 0) {
+		size_t i;
+
+		for (i = 0; i < INDEX_CNT; i++) {
+			release_sectors (index_slot (NULL, sector, i, false), level - 1);
+		}
 	}
+	free_map_release (sector, 1);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;
+static struct condition inode_loaded;   /* An inode finished loading. */
+
+static unsigned inode_hash (const struct hash_elem*, void* aux);
+static bool inode_less (const struct hash_elem*, const struct hash_elem*,
+                        void* aux);
 
 /* Initializes the inode module. */
 void
 inode_init (void) {
-	list_init (&open_inodes);
+	if (!hash_init (&open_inodes, inode_hash, inode_less, NULL)) {
+		PANIC ("no memory for open inode table");
+	}
+	lock_init (&open_inodes_lock);
+	cond_init (&inode_loaded);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  No data sectors are allocated: the file starts out
+   as one hole, and sectors are allocated as they are written.
+   The inode is a directory if IS_DIR is true.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is too
+   large. */
 bool
-inode_create (block_sector_t sector, off_t length) {
+inode_create (block_sector_t sector, off_t length, bool is_dir) {
 	struct inode_disk* disk_inode = NULL;
 	bool success = false;
 
@@ -76,23 +210,17 @@ inode_create (block_sector_t sector, off_t length) {
 	   one sector in size, and you should fix that. */
 	ASSERT (sizeof * disk_inode == BLOCK_SECTOR_SIZE);
 
+	if (length > INODE_MAX_LENGTH) {
+		return false;
+	}
 	disk_inode = calloc (1, sizeof * disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
 		disk_inode->length = length;
+		disk_inode->is_dir = is_dir;
+		disk_inode->parent = sector;
 		disk_inode->magic = INODE_MAGIC;
-		if (free_map_allocate (sectors, &disk_inode->start)) {
-			block_write (fs_device, sector, disk_inode);
-			if (sectors > 0) {
-				static char zeros[BLOCK_SECTOR_SIZE];
-				size_t i;
-
-				for (i = 0; i < sectors; i++) {
-					block_write (fs_device, disk_inode->start + i, zeros);
-				}
-			}
-			success = true;
-		}
+		cache_write (sector, disk_inode);
+		success = true;
 		free (disk_inode);
 	}
 	return success;
@@ -103,32 +231,65 @@ inode_create (block_sector_t sector, off_t length) {
    Returns a null pointer if memory allocation fails. */
 struct inode*
 inode_open (block_sector_t sector) {
-	struct list_elem* e;
+	struct inode key;
+	struct hash_elem* e;
 	struct inode* inode;
 
-	/* Check whether this inode is already open. */
-	for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-	     e = list_next (e)) {
-		inode = list_entry (e, struct inode, elem);
-		if (inode->sector == sector) {
-			inode_reopen (inode);
-			return inode;
+	/* Check whether this inode is already open.  If another thread
+	   is still reading it in, wait for it to finish. */
+	key.sector = sector;
+	lock_acquire (&open_inodes_lock);
+	e = hash_find (&open_inodes, &key.elem);
+	if (e != NULL) {
+		inode = hash_entry (e, struct inode, elem);
+		inode->open_cnt++;
+		while (inode->loading) {
+			cond_wait (&inode_loaded, &open_inodes_lock);
 		}
+		lock_release (&open_inodes_lock);
+		return inode;
 	}
 
 	/* Allocate memory. */
 	inode = malloc (sizeof * inode);
 	if (inode == NULL) {
+		lock_release (&open_inodes_lock);
 		return NULL;
 	}
 
-	/* Initialize. */
-	list_push_front (&open_inodes, &inode->elem);
+	/* Initialize, and publish the inode as loading, so that a second
+	   opener of SECTOR finds it and waits, before dropping the lock
+	   for the disk reads below.  Opens of other inodes don't wait
+	   behind them. */
 	inode->sector = sector;
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	block_read (fs_device, inode->sector, &inode->data);
+	inode->loading = true;
+	rwlock_init (&inode->rw);
+	lock_init (&inode->dir_lock);
+	inode->last_sector = sector;
+	inode->ra_next = 0;
+	inode->ra_end = 0;
+	inode->ra_window = 0;
+	hash_insert (&open_inodes, &inode->elem);
+	lock_release (&open_inodes_lock);
+
+	cache_read (inode->sector, &inode->data);
+
+	/* Grow the file from its current last block, if it has one. */
+	if (inode->data.length > 0) {
+		block_sector_t last = byte_to_sector (inode, inode->data.length - 1,
+		                                      false);
+		if (last != 0) {
+			inode->last_sector = last;
+		}
+	}
+
+	lock_acquire (&open_inodes_lock);
+	inode->loading = false;
+	cond_broadcast (&inode_loaded, &open_inodes_lock);
+	lock_release (&open_inodes_lock);
 	return inode;
 }
 
@@ -136,7 +297,9 @@ inode_open (block_sector_t sector) {
 struct inode*
 inode_reopen (struct inode* inode) {
 	if (inode != NULL) {
+		lock_acquire (&open_inodes_lock);
 		inode->open_cnt++;
+		lock_release (&open_inodes_lock);
 	}
 	return inode;
 }
@@ -147,6 +310,65 @@ inode_get_inumber (const struct inode* inode) {
 	return inode->sector;
 }
 
+/* Returns true if INODE is a directory. */
+bool
+inode_is_dir (const struct inode* inode) {
+	return inode->data.is_dir;
+}
+
+/* Returns the number of openers of INODE. */
+int
+inode_open_cnt (const struct inode* inode) {
+	int open_cnt;
+
+	lock_acquire (&open_inodes_lock);
+	open_cnt = inode->open_cnt;
+	lock_release (&open_inodes_lock);
+	return open_cnt;
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode* inode) {
+	bool removed;
+
+	lock_acquire (&open_inodes_lock);
+	removed = inode->removed;
+	lock_release (&open_inodes_lock);
+	return removed;
+}
+
+/* Acquires the lock on the entries of directory INODE. */
+void
+inode_lock_dir (struct inode* inode) {
+	ASSERT (inode_is_dir (inode));
+	lock_acquire (&inode->dir_lock);
+}
+
+/* Releases the lock on the entries of directory INODE. */
+void
+inode_unlock_dir (struct inode* inode) {
+	lock_release (&inode->dir_lock);
+}
+
+/* Returns the inode number of the directory that contains
+   directory INODE.  The root is its own parent. */
+block_sector_t
+inode_get_parent (const struct inode* inode) {
+	ASSERT (inode_is_dir (inode));
+	return inode->data.parent;
+}
+
+/* Records PARENT as the directory that contains directory INODE. */
+void
+inode_set_parent (struct inode* inode, block_sector_t parent) {
+	ASSERT (inode_is_dir (inode));
+	rwlock_acquire_write (&inode->rw);
+	inode->data.parent = parent;
+	cache_write (inode->sector, &inode->data);
+	rwlock_release_write (&inode->rw);
+}
+
 /* Closes INODE and writes it to disk. (Does it?  Check code.)
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -158,15 +380,24 @@ inode_close (struct inode* inode) {
 	}
 
 	/* Release resources if this was the last opener. */
-	if (--inode->open_cnt == 0) {
-		/* Remove from inode list and release lock. */
-		list_remove (&inode->elem);
+	lock_acquire (&open_inodes_lock);
+	if (--inode->open_cnt > 0) {
+		lock_release (&open_inodes_lock);
+	} else {
+		/* Remove from inode table and release lock. */
+		hash_delete (&open_inodes, &inode->elem);
+		lock_release (&open_inodes_lock);
 
 		/* Deallocate blocks if removed. */
 		if (inode->removed) {
+			size_t i;
+
+			for (i = 0; i < DIRECT_CNT; i++) {
+				release_sectors (inode->data.direct[i], 0);
+			}
+			release_sectors (inode->data.indirect, 1);
+			release_sectors (inode->data.doubly_indirect, 2);
 			free_map_release (inode->sector, 1);
-			free_map_release (inode->data.start,
-			                  bytes_to_sectors (inode->data.length));
 		}
 
 		free (inode);
@@ -178,22 +409,66 @@ inode_close (struct inode* inode) {
 void
 inode_remove (struct inode* inode) {
 	ASSERT (inode != NULL);
+	lock_acquire (&open_inodes_lock);
 	inode->removed = true;
+	lock_release (&open_inodes_lock);
+}
+
+/* Notes that sector index IDX of INODE is being read and queues
+   read-ahead for the sectors after it.  A read that follows the
+   previous one doubles the window, up to READ_AHEAD_MAX sectors,
+   so longer streams are fetched further ahead; another read of
+   the same sector changes nothing, and any other read turns
+   read-ahead off until the stream resumes. */
+static void
+inode_read_ahead (struct inode* inode, off_t idx) {
+	off_t last = bytes_to_sectors (inode_length (inode));
+	off_t i;
+
+	if (idx == inode->ra_next - 1) {
+		return;                           /* Same sector as last time. */
+	}
+	if (idx == inode->ra_next) {
+		inode->ra_window = inode->ra_window == 0 ? READ_AHEAD_MIN
+		                   : inode->ra_window * 2;
+		if (inode->ra_window > READ_AHEAD_MAX) {
+			inode->ra_window = READ_AHEAD_MAX;
+		}
+	} else {
+		inode->ra_window = 0;
+		inode->ra_end = idx + 1;
+	}
+	inode->ra_next = idx + 1;
+
+	if (inode->ra_end < idx + 1) {
+		inode->ra_end = idx + 1;
+	}
+	for (i = inode->ra_end; i <= idx + inode->ra_window && i < last; i++) {
+		block_sector_t sector = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE,
+		                                        false);
+		if (sector != 0) {
+			cache_read_ahead (sector);
+		}
+	}
+	if (inode->ra_end < i) {
+		inode->ra_end = i;
+	}
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   Bytes in holes read as zeros. */
 off_t
 inode_read_at (struct inode* inode, void* buffer_, off_t size, off_t offset) {
 	uint8_t* buffer = buffer_;
 	off_t bytes_read = 0;
-	uint8_t* bounce = NULL;
 
+	rwlock_acquire_read (&inode->rw);
 	while (size > 0) {
 		/* Disk sector to read, starting byte offset within sector. */
-		block_sector_t sector_idx = byte_to_sector (inode, offset);
 		int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+		block_sector_t sector_idx;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
 		off_t inode_left = inode_length (inode) - offset;
@@ -206,20 +481,15 @@ inode_read_at (struct inode* inode, void* buffer_, off_t size, off_t offset) {
 			break;
 		}
 
-		if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			block_read (fs_device, sector_idx, buffer + bytes_read);
+		if (sector_ofs == 0 || bytes_read == 0) {
+			inode_read_ahead (inode, offset / BLOCK_SECTOR_SIZE);
+		}
+		sector_idx = byte_to_sector (inode, offset, false);
+		if (sector_idx != 0) {
+			cache_read_at (sector_idx, buffer + bytes_read, sector_ofs,
+			               chunk_size);
 		} else {
-			/* Read sector into bounce buffer, then partially copy
-			   into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (BLOCK_SECTOR_SIZE);
-				if (bounce == NULL) {
-					break;
-				}
-			}
-			block_read (fs_device, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+			memset (buffer + bytes_read, 0, chunk_size);
 		}
 
 		/* Advance. */
@@ -227,34 +497,31 @@ inode_read_at (struct inode* inode, void* buffer_, off_t size, off_t offset) {
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
+	rwlock_release_read (&inode->rw);
 
 	return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode* inode, const void* buffer_, off_t size,
-                off_t offset) {
-	const uint8_t* buffer = buffer_;
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   stopping early at the first sector that does not exist yet.
+   If GROW is true, such sectors are allocated instead and the
+   write may go past end of file, up to INODE_MAX_LENGTH.
+   Returns the number of bytes written.  The caller must hold
+   INODE's lock: shared is enough unless GROW is true. */
+static off_t
+write_chunks (struct inode* inode, const uint8_t* buffer, off_t size,
+              off_t offset, bool grow) {
+	off_t end = grow ? INODE_MAX_LENGTH : inode->data.length;
 	off_t bytes_written = 0;
-	uint8_t* bounce = NULL;
-
-	if (inode->deny_write_cnt) {
-		return 0;
-	}
 
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
-		block_sector_t sector_idx = byte_to_sector (inode, offset);
+		block_sector_t sector_idx;
 		int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-		/* Bytes left in inode, bytes left in sector, lesser of the two. */
-		off_t inode_left = inode_length (inode) - offset;
+		/* Room left before END, bytes left in sector, lesser of
+		   the two. */
+		off_t inode_left = end - offset;
 		int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
 		int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -264,36 +531,66 @@ inode_write_at (struct inode* inode, const void* buffer_, off_t size,
 			break;
 		}
 
-		if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			block_write (fs_device, sector_idx, buffer + bytes_written);
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (BLOCK_SECTOR_SIZE);
-				if (bounce == NULL) {
-					break;
-				}
-			}
-
-			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left) {
-				block_read (fs_device, sector_idx, bounce);
-			} else {
-				memset (bounce, 0, BLOCK_SECTOR_SIZE);
-			}
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			block_write (fs_device, sector_idx, bounce);
+		sector_idx = byte_to_sector (inode, offset, grow);
+		if (sector_idx == 0) {
+			break;
 		}
 
+		/* The cache reads the sector first only if the chunk
+		   leaves part of it untouched. */
+		cache_write_at (sector_idx, buffer + bytes_written, sector_ofs,
+		                chunk_size);
+
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
+	return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   A write past end of file extends the inode; any gap between
+   the old end and OFFSET becomes a hole.  Returns the number of
+   bytes actually written, which may be less than SIZE if the
+   disk fills up or the file reaches INODE_MAX_LENGTH.
+
+   Writes into sectors that already exist only share INODE's
+   lock, so they may run alongside reads and other such writes.
+   Whatever is left needs sectors allocated or the file extended,
+   and is done holding the lock exclusively. */
+off_t
+inode_write_at (struct inode* inode, const void* buffer_, off_t size,
+                off_t offset) {
+	const uint8_t* buffer = buffer_;
+	off_t bytes_written;
+	bool denied;
+
+	lock_acquire (&open_inodes_lock);
+	denied = inode->deny_write_cnt > 0;
+	lock_release (&open_inodes_lock);
+	if (denied) {
+		return 0;
+	}
+
+	rwlock_acquire_read (&inode->rw);
+	bytes_written = write_chunks (inode, buffer, size, offset, false);
+	rwlock_release_read (&inode->rw);
+
+	if (bytes_written < size) {
+		rwlock_acquire_write (&inode->rw);
+		bytes_written += write_chunks (inode, buffer + bytes_written,
+		                               size - bytes_written,
+		                               offset + bytes_written, true);
+
+		/* Extend the file only once the data is in place, so a
+		   concurrent reader never sees bytes that were not written. */
+		if (offset + bytes_written > inode->data.length) {
+			inode->data.length = offset + bytes_written;
+			cache_write (inode->sector, &inode->data);
+		}
+		rwlock_release_write (&inode->rw);
+	}
 
 	return bytes_written;
 }
@@ -302,8 +599,10 @@ inode_write_at (struct inode* inode, const void* buffer_, off_t size,
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode* inode) {
+	lock_acquire (&open_inodes_lock);
 	inode->deny_write_cnt++;
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+	lock_release (&open_inodes_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -311,9 +610,11 @@ inode_deny_write (struct inode* inode) {
    inode_deny_write() on the inode, before closing the inode. */
 void
 inode_allow_write (struct inode* inode) {
+	lock_acquire (&open_inodes_lock);
 	ASSERT (inode->deny_write_cnt > 0);
 	ASSERT (inode->deny_write_cnt <= inode->open_cnt);
 	inode->deny_write_cnt--;
+	lock_release (&open_inodes_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -321,3 +622,17 @@ off_t
 inode_length (const struct inode* inode) {
 	return inode->data.length;
 }
+
+/* Hashes an inode by sector. */
+static unsigned
+inode_hash (const struct hash_elem* e, void* aux UNUSED) {
+	return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+/* Orders inodes by sector. */
+static bool
+inode_less (const struct hash_elem* a, const struct hash_elem* b,
+            void* aux UNUSED) {
+	return hash_entry (a, struct inode, elem)->sector
+	       < hash_entry (b, struct inode, elem)->sector;
+}
@@ -8,10 +8,17 @@
 struct bitmap;
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
 struct inode* inode_open (block_sector_t);
 struct inode* inode_reopen (struct inode*);
 block_sector_t inode_get_inumber (const struct inode*);
+bool inode_is_dir (const struct inode*);
+int inode_open_cnt (const struct inode*);
+bool inode_is_removed (const struct inode*);
+void inode_lock_dir (struct inode*);
+void inode_unlock_dir (struct inode*);
+block_sector_t inode_get_parent (const struct inode*);
+void inode_set_parent (struct inode*, block_sector_t);
 void inode_close (struct inode*);
 void inode_remove (struct inode*);
 off_t inode_read_at (struct inode*, void*, off_t size, off_t offset);
@@ -4,6 +4,8 @@
 #include "kernel/gdt.h"
 #include "kernel/interrupt.h"
 #include "kernel/thread.h"
+#include "kernel/vaddr.h"
+#include "vm/page.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -104,9 +106,10 @@ kill (struct intr_frame* f) {
 	}
 }
 
-/* Page fault handler.  This is a skeleton that must be filled in
-   to implement virtual memory.  Some solutions to project 2 may
-   also require modifying this code.
+/* Page fault handler.  Resolves faults on user pages that are
+   not resident through the VM subsystem (see vm/page.c), recovers
+   from bad user pointers dereferenced by system calls, and kills
+   the process on any other fault.
 
    At entry, the address that faulted is in CR2 (Control Register
    2) and information about the fault, formatted as described in
@@ -143,6 +146,23 @@ page_fault (struct intr_frame* f) {
 	write = (f->error_code & PF_W) != 0;
 	user = (f->error_code & PF_U) != 0;
 
+	/* A not-present user page that the process owns is simply
+	   brought in: read from its executable on first touch,
+	   zero-filled, or swapped back in.  A fault just below the
+	   stack pointer grows the stack instead.  Returning restarts
+	   the faulting instruction.  This covers faults from system
+	   call code touching user buffers as well as faults in user
+	   code; for the former, the user esp is the one saved at
+	   system call entry. */
+	if (not_present && fault_addr != NULL && is_user_vaddr (fault_addr)
+	    && thread_current ()->pagedir != NULL) {
+		void* esp = user ? f->esp : thread_current ()->user_esp;
+		if (page_load (pg_round_down (fault_addr))
+		    || page_grow_stack (fault_addr, esp)) {
+			return;
+		}
+	}
+
 	/* Handle bad dereferences from system call implementations. */
 	if (!user) {
 		f->eip = (void (*) (void)) f->eax;
@@ -150,18 +170,12 @@ page_fault (struct intr_frame* f) {
 		return;
 	}
 
-
-	/* To implement virtual memory, delete the rest of the function
-	   body, and replace it with code that brings in the page to
-	   which fault_addr refers. */
+	/* Anything else is a genuine fault by the user program. */
 	printf ("Page fault at %p: %s error %s page in %s context.\n",
 	        fault_addr,
 	        not_present ? "not present" : "rights violation",
 	        write ? "writing" : "reading",
 	        user ? "user" : "kernel");
-
-	printf("There is no crying in Pintos!\n");
-
 	kill (f);
 }
 
@@ -111,6 +111,16 @@ palloc_get_page (enum palloc_flags flags) {
 	return palloc_get_multiple (flags, 1);
 }
 
+/* Stores the base address and page count of the user pool in
+   *BASE and *PAGE_CNT.  Page I of the user pool lives at
+   *BASE + I * PGSIZE, which lets the frame table index its
+   entries directly by kernel virtual address. */
+void
+palloc_get_user_pool (void** base, size_t* page_cnt) {
+	*base = user_pool.base;
+	*page_cnt = bitmap_size (user_pool.used_map);
+}
+
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void* pages, size_t page_cnt) {
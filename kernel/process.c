@@ -15,12 +15,15 @@
 #include "kernel/init.h"
 #include "kernel/interrupt.h"
 #include "kernel/palloc.h"
+#include "kernel/syscall.h"
 #include "kernel/thread.h"
 #include "kernel/vaddr.h"
 #include "vm/frame.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *file_args, void (**eip) (void), void **esp,tid_t id);
+static bool load (const char *file_args, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
    CMDLINE.  The new thread may be scheduled (and may even exit)
@@ -103,16 +106,20 @@ start_process (void *file_args_)
 {
   struct thread *curr = thread_current ();
   char *file_args = file_args_;
-	tid_t id = curr->tid;
   struct intr_frame if_;
   bool success;
 
+  /* Start in the parent's working directory.  The parent is
+     waiting on exec_sema, so its cwd can't change under us. */
+  if (curr->parent != NULL && curr->parent->cwd != NULL)
+    curr->cwd = dir_reopen (curr->parent->cwd);
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (file_args, &if_.eip, &if_.esp,id);
+  success = load (file_args, &if_.eip, &if_.esp);
 
   /* If load failed, quit. */
   palloc_free_page (file_args);
@@ -184,7 +191,19 @@ process_exit (void)
 {
   struct thread *cur = thread_current ();
   uint32_t *pd;
-  tid_t id=cur->tid;
+
+  /* Close the process's files here, not when its struct thread
+     is freed: closing may sleep on file system locks, which the
+     scheduler can't do. */
+  if (cur->exec_file != NULL)
+    {
+      file_close (cur->exec_file);
+      cur->exec_file = NULL;
+    }
+  syscall_exit ();
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -197,7 +216,9 @@ process_exit (void)
          directory before destroying the process's page
          directory, or our active page directory will be one
          that's been freed (and cleared). */
-			wipe_thread_pages(id);
+      mmap_unmap_all ();
+      wipe_thread_pages (cur);
+      page_table_destroy (cur);
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
@@ -284,18 +305,18 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp, const char *file_args,tid_t id);
+static bool setup_stack (void **esp, const char *file_args);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
-                          bool writable,tid_t id);
+                          bool writable);
 
 /* Loads an ELF executable from FILE_ARGS into the current thread.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
    Returns true if successful, false otherwise. */
 bool
-load (const char *file_args, void (**eip) (void), void **esp,tid_t id)
+load (const char *file_args, void (**eip) (void), void **esp)
 {
   struct thread *t = thread_current ();
   struct Elf32_Ehdr ehdr;
@@ -306,7 +327,7 @@ load (const char *file_args, void (**eip) (void), void **esp,tid_t id)
 
   /* Allocate and activate page directory. */
   t->pagedir = pagedir_create ();
-  if (t->pagedir == NULL)
+  if (t->pagedir == NULL || !page_table_init (t))
     goto done;
   process_activate ();
 
@@ -382,7 +403,7 @@ load (const char *file_args, void (**eip) (void), void **esp,tid_t id)
                   zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
                 }
               if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable,id))
+                                 read_bytes, zero_bytes, writable))
                 goto done;
             }
           else
@@ -392,7 +413,7 @@ load (const char *file_args, void (**eip) (void), void **esp,tid_t id)
     }
 
   /* Set up stack. */
-  if (!setup_stack (esp, file_args,id))
+  if (!setup_stack (esp, file_args))
     goto done;
 
   /* Start address. */
@@ -408,8 +429,6 @@ load (const char *file_args, void (**eip) (void), void **esp,tid_t id)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -467,17 +486,20 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   Each page is only recorded in the supplemental page table here.
+   Nothing is read until the process first touches the page and
+   the page fault handler calls page_load().
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
-              uint32_t read_bytes, uint32_t zero_bytes, bool writable,tid_t id)
+              uint32_t read_bytes, uint32_t zero_bytes, bool writable)
 {
   ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
-  file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0)
     {
       /* Calculate how to fill this page.
@@ -485,32 +507,20 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
          and zero the final PAGE_ZERO_BYTES bytes. */
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      /* Get a page of memory. */
-      uint8_t *kpage = acquire_user_page(id,0,0);//palloc_get_page()
-      if (kpage == NULL)
-        return false;
-
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-					//printf("FREEING USER PAGE\n");
-          free_user_page(kpage);//palloc_free_page (kpage);
-          return false;
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
+      struct page_entry *p;
 
       /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable))
-        {
-					//printf("FREEING USER PAGE\n");
-          free_user_page(kpage);//palloc_free_page (kpage);
-          return false;
-        }
+      if (page_read_bytes > 0)
+        p = page_add_file (upage, file, ofs, page_read_bytes, writable);
+      else
+        p = page_add_zero (upage, writable, false);
+      if (p == NULL)
+        return false;
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
+      ofs += page_read_bytes;
       upage += PGSIZE;
     }
   return true;
@@ -519,20 +529,19 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool
-setup_stack (void **esp, const char *file_args,tid_t id)
+setup_stack (void **esp, const char *file_args)
 {
-  uint8_t *kpage;
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
   char *esp_char;
   unsigned int *esp_uint;
   int *esp_int;
   int total_bytes;
   int argc = 0;
   bool success = false;
-  //printf("GETTING USER PAGE\n");
-  kpage = acquire_user_page(id,1,1);//palloc_get_page (PAL_USER | PAL_ZERO);
-  if (kpage != NULL)
+
+  if (page_add_zero (upage, true, true) != NULL)
     {
-      success = install_page (((uint8_t *) PHYS_BASE) - PGSIZE, kpage, true);
+      success = page_load (upage);
       if (success)
         {
           /* Extract the TOTAL_BYTES to push initially, and decrement
@@ -584,28 +593,6 @@ setup_stack (void **esp, const char *file_args,tid_t id)
 
           //hex_dump ((uintptr_t) *esp, *esp, (size_t) (PHYS_BASE - *esp), 1);
         }
-      else
-        free_user_page(kpage);//palloc_free_page (kpage);
     }
   return success;
 }
-
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
-{
-  struct thread *t = thread_current ();
-
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
-}
@@ -97,7 +97,8 @@ sema_try_down (struct semaphore* sema) {
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -107,11 +108,15 @@ sema_up (struct semaphore* sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters))
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-		                            struct thread, elem));
+	if (!list_empty (&sema->waiters)) {
+		struct list_elem* e = list_max (&sema->waiters,
+		                                thread_priority_less, NULL);
+		list_remove (e);
+		thread_unblock (list_entry (e, struct thread, elem));
+	}
 	sema->value++;
 	intr_set_level (old_level);
+	thread_preempt ();
 }
 
 static void sema_test_helper (void* sema_);
@@ -172,7 +177,9 @@ lock_init (struct lock* lock) {
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
-   thread.
+   thread.  While it sleeps, the current thread donates its
+   priority to the lock's holder, and through it to any holders
+   that one is waiting on in turn.
 
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
@@ -180,12 +187,23 @@ lock_init (struct lock* lock) {
    we need to sleep. */
 void
 lock_acquire (struct lock* lock) {
+	struct thread* cur = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
+	if (lock->holder != NULL) {
+		cur->waiting_lock = lock;
+		thread_donate_priority (cur);
+	}
 	sema_down (&lock->semaphore);
-	lock->holder = thread_current ();
+	cur->waiting_lock = NULL;
+	lock->holder = cur;
+	list_push_back (&cur->held_locks, &lock->elem);
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -196,30 +214,43 @@ lock_acquire (struct lock* lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock* lock) {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
 	if (success) {
 		lock->holder = thread_current ();
+		list_push_back (&lock->holder->held_locks, &lock->elem);
 	}
+	intr_set_level (old_level);
 	return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Drops any priority donated through LOCK, then yields if a
+   waiter that just became ready outranks the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void
 lock_release (struct lock* lock) {
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
+	list_remove (&lock->elem);
 	lock->holder = NULL;
+	thread_update_priority (thread_current ());
 	sema_up (&lock->semaphore);
+	intr_set_level (old_level);
+	thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -236,8 +267,12 @@ lock_held_by_current_thread (const struct lock* lock) {
 struct semaphore_elem {
 	struct list_elem elem;              /* List element. */
 	struct semaphore semaphore;         /* This semaphore. */
+	struct thread* thread;              /* Thread waiting on it. */
 };
 
+static bool waiter_priority_less (const struct list_elem*,
+                                  const struct list_elem*, void* aux);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -278,6 +313,7 @@ cond_wait (struct condition* cond, struct lock* lock) {
 	ASSERT (lock_held_by_current_thread (lock));
 
 	sema_init (&waiter.semaphore, 0);
+	waiter.thread = thread_current ();
 	list_push_back (&cond->waiters, &waiter.elem);
 	lock_release (lock);
 	sema_down (&waiter.semaphore);
@@ -285,7 +321,8 @@ cond_wait (struct condition* cond, struct lock* lock) {
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the highest-priority one to wake up from
+   its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -298,9 +335,12 @@ cond_signal (struct condition* cond, struct lock* lock UNUSED) {
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters))
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-		                      struct semaphore_elem, elem)->semaphore);
+	if (!list_empty (&cond->waiters)) {
+		struct list_elem* e = list_max (&cond->waiters,
+		                                waiter_priority_less, NULL);
+		list_remove (e);
+		sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+	}
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -318,3 +358,78 @@ cond_broadcast (struct condition* cond, struct lock* lock) {
 		cond_signal (cond, lock);
 	}
 }
+
+/* Orders condition variable waiters by the priority of their
+   threads. */
+static bool
+waiter_priority_less (const struct list_elem* a, const struct list_elem* b,
+                      void* aux UNUSED) {
+	return list_entry (a, struct semaphore_elem, elem)->thread->priority
+	       < list_entry (b, struct semaphore_elem, elem)->thread->priority;
+}
+
+/* Initializes RW as a readers-writer lock that nobody holds. */
+void
+rwlock_init (struct rwlock* rw) {
+	ASSERT (rw != NULL);
+
+	lock_init (&rw->lock);
+	cond_init (&rw->can_read);
+	cond_init (&rw->can_write);
+	rw->readers = 0;
+	rw->waiting_writers = 0;
+	rw->writing = false;
+}
+
+/* Acquires RW for reading, sleeping until no thread is writing
+   or waiting to write. */
+void
+rwlock_acquire_read (struct rwlock* rw) {
+	lock_acquire (&rw->lock);
+	while (rw->writing || rw->waiting_writers > 0) {
+		cond_wait (&rw->can_read, &rw->lock);
+	}
+	rw->readers++;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread acquired for reading. */
+void
+rwlock_release_read (struct rwlock* rw) {
+	lock_acquire (&rw->lock);
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0) {
+		cond_signal (&rw->can_write, &rw->lock);
+	}
+	lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it. */
+void
+rwlock_acquire_write (struct rwlock* rw) {
+	lock_acquire (&rw->lock);
+	rw->waiting_writers++;
+	while (rw->writing || rw->readers > 0) {
+		cond_wait (&rw->can_write, &rw->lock);
+	}
+	rw->waiting_writers--;
+	rw->writing = true;
+	lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread acquired for writing.
+   Another writer goes next if one is waiting; otherwise all
+   waiting readers do. */
+void
+rwlock_release_write (struct rwlock* rw) {
+	lock_acquire (&rw->lock);
+	ASSERT (rw->writing);
+	rw->writing = false;
+	if (rw->waiting_writers > 0) {
+		cond_signal (&rw->can_write, &rw->lock);
+	} else {
+		cond_broadcast (&rw->can_read, &rw->lock);
+	}
+	lock_release (&rw->lock);
+}
@@ -18,8 +18,9 @@ void sema_self_test (void);
 
 /* Lock. */
 struct lock {
-	struct thread* holder;      /* Thread holding lock (for debugging). */
+	struct thread* holder;      /* Thread holding lock. */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct list_elem elem;      /* Element in holder's held_locks. */
 };
 
 void lock_init (struct lock*);
@@ -38,6 +39,24 @@ void cond_wait (struct condition*, struct lock*);
 void cond_signal (struct condition*, struct lock*);
 void cond_broadcast (struct condition*, struct lock*);
 
+/* Readers-writer lock.  Any number of readers or one writer may
+   hold it at a time.  Waiting writers keep new readers out, so
+   writers are not starved. */
+struct rwlock {
+	struct lock lock;           /* Guards the fields below. */
+	struct condition can_read;  /* Signaled when readers may proceed. */
+	struct condition can_write; /* Signaled when a writer may proceed. */
+	unsigned readers;           /* Number of threads reading. */
+	unsigned waiting_writers;   /* Number of threads waiting to write. */
+	bool writing;               /* Is a thread writing? */
+};
+
+void rwlock_init (struct rwlock*);
+void rwlock_acquire_read (struct rwlock*);
+void rwlock_release_read (struct rwlock*);
+void rwlock_acquire_write (struct rwlock*);
+void rwlock_release_write (struct rwlock*);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -4,14 +4,21 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <syscall-nr.h>
+#include <syscall-stats.h>
 #include <string.h>
 #include "kernel/thread.h"
 #include "kernel/interrupt.h"
 #include "kernel/vaddr.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
+#include "kernel/malloc.h"
+#include "kernel/palloc.h"
+#include "vm/mmap.h"
+#include "vm/page.h"
 
 static void syscall_handler (struct intr_frame*);
 
@@ -20,437 +27,778 @@ syscall_init (void) {
 	intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
-bool is_valid_ptr (void* ptr);
-void halt (struct intr_frame* f);
-void exit (struct intr_frame* f);
-void exec (struct intr_frame* f);
-void wait (struct intr_frame* f);
-void create (struct intr_frame* f);
-void remove (struct intr_frame* f);
-void open (struct intr_frame* f);
-void filesize (struct intr_frame* f);
-void read (struct intr_frame* f);
-void write (struct intr_frame* f);
-void seek (struct intr_frame* f);
-void tell (struct intr_frame* f);
-void close (struct intr_frame* f);
+static void halt (struct intr_frame* f, const uint32_t* args);
+static void exit (struct intr_frame* f, const uint32_t* args);
+static void exec (struct intr_frame* f, const uint32_t* args);
+static void wait (struct intr_frame* f, const uint32_t* args);
+static void create (struct intr_frame* f, const uint32_t* args);
+static void remove (struct intr_frame* f, const uint32_t* args);
+static void open (struct intr_frame* f, const uint32_t* args);
+static void filesize (struct intr_frame* f, const uint32_t* args);
+static void read (struct intr_frame* f, const uint32_t* args);
+static void write (struct intr_frame* f, const uint32_t* args);
+static void seek (struct intr_frame* f, const uint32_t* args);
+static void tell (struct intr_frame* f, const uint32_t* args);
+static void close (struct intr_frame* f, const uint32_t* args);
+static void mmap (struct intr_frame* f, const uint32_t* args);
+static void munmap (struct intr_frame* f, const uint32_t* args);
+static void chdir (struct intr_frame* f, const uint32_t* args);
+static void mkdir (struct intr_frame* f, const uint32_t* args);
+static void readdir (struct intr_frame* f, const uint32_t* args);
+static void isdir (struct intr_frame* f, const uint32_t* args);
+static void inumber (struct intr_frame* f, const uint32_t* args);
+static void dup (struct intr_frame* f, const uint32_t* args);
+static void dup2 (struct intr_frame* f, const uint32_t* args);
+static void sysstats (struct intr_frame* f, const uint32_t* args);
+
+/* Lowest descriptor for files; 0 and 1 are the console. */
+#define FD_FIRST 2
+
+/* Slots in a process's descriptor table when it first opens a file. */
+#define FD_TABLE_MIN 16
+
+/* Most bytes of a user buffer that read() and write() pin at once.
+   Pinning a whole buffer bigger than the user pool would leave the
+   evictor nothing to evict. */
+#define IO_CHUNK_SIZE (4 * PGSIZE)
+
+static bool copy_from_user (void* dst, const void* usrc, size_t size);
+static bool copy_to_user (void* udst, const void* src, size_t size);
+static int strncpy_from_user (char* dst, const char* usrc, size_t size);
+static char* get_string (const char* ustr);
+
+static struct file_mapping* find_file (int fd);
+static int fd_install (struct file_mapping* m, int fd);
+static void fd_release (int fd);
+
+/* Most arguments any system call takes. */
+#define SYSCALL_MAX_ARGS 3
+
+/* A system call handler.  ARGS holds the call's arguments, already
+   copied in from the user stack; the result goes in F->eax. */
+typedef void syscall_func (struct intr_frame* f, const uint32_t* args);
+
+/* A system call: its handler, how many arguments it takes, and
+   statistics over all processes.  The statistics are updated with
+   interrupts off.  Their histogram misses calls that never return,
+   such as exit. */
+struct syscall {
+	syscall_func* func;         /* Handler, or NULL if not implemented. */
+	int arg_cnt;                /* Number of 32-bit arguments. */
+	const char* name;           /* Name, for statistics. */
+	struct syscall_stats stats; /* Calls and time spent in FUNC. */
+};
+
+/* System calls, indexed by number. */
+static struct syscall syscalls[] = {
+	[SYS_HALT]     = {halt, 0, "halt"},
+	[SYS_EXIT]     = {exit, 1, "exit"},
+	[SYS_EXEC]     = {exec, 1, "exec"},
+	[SYS_WAIT]     = {wait, 1, "wait"},
+	[SYS_CREATE]   = {create, 2, "create"},
+	[SYS_REMOVE]   = {remove, 1, "remove"},
+	[SYS_OPEN]     = {open, 1, "open"},
+	[SYS_FILESIZE] = {filesize, 1, "filesize"},
+	[SYS_READ]     = {read, 3, "read"},
+	[SYS_WRITE]    = {write, 3, "write"},
+	[SYS_SEEK]     = {seek, 2, "seek"},
+	[SYS_TELL]     = {tell, 1, "tell"},
+	[SYS_CLOSE]    = {close, 1, "close"},
+	[SYS_MMAP]     = {mmap, 2, "mmap"},
+	[SYS_MUNMAP]   = {munmap, 1, "munmap"},
+	[SYS_CHDIR]    = {chdir, 1, "chdir"},
+	[SYS_MKDIR]    = {mkdir, 1, "mkdir"},
+	[SYS_READDIR]  = {readdir, 2, "readdir"},
+	[SYS_ISDIR]    = {isdir, 1, "isdir"},
+	[SYS_INUMBER]  = {inumber, 1, "inumber"},
+	[SYS_DUP]      = {dup, 1, "dup"},
+	[SYS_DUP2]     = {dup2, 2, "dup2"},
+	[SYS_STATS]    = {sysstats, 3, "stats"},
+};
+
+#define SYSCALL_CNT (sizeof syscalls / sizeof * syscalls)
+
+/* Returns the processor's time stamp counter. */
+static inline uint64_t
+rdtsc (void) {
+	uint64_t tsc;
+	asm volatile ("rdtsc" : "=A" (tsc));
+	return tsc;
+}
+
+/* Returns the latency histogram bucket for a call that took
+   CYCLES cycles. */
+static int
+latency_bucket (uint64_t cycles) {
+	if (cycles >> 32 != 0) {
+		return SYSCALL_HIST_BUCKETS - 1;
+	}
+	if (cycles == 0) {
+		return 0;
+	}
+	return 31 - __builtin_clz ((uint32_t) cycles);
+}
 
+/* Looks up the system call whose number is on top of the user
+   stack, copies its arguments in with a single copy_from_user(),
+   and runs it.  A bad stack pointer kills the process; an unknown
+   system call number is ignored. */
 static void
 syscall_handler (struct intr_frame* f) {
-	int* syscall_num = (int*) (f->esp);
-	if (!is_valid_ptr ((void*) syscall_num)) {
+	struct thread* cur = thread_current ();
+	uint32_t frame[1 + SYSCALL_MAX_ARGS];
+	struct syscall* sc;
+	struct syscall_stats* mine;
+	enum intr_level old_level;
+	uint64_t start, cycles;
+	int bucket;
+
+	cur->user_esp = f->esp;
+	if (!copy_from_user (frame, f->esp, sizeof frame[0])) {
+		thread_exit ();
+	}
+	if (frame[0] >= SYSCALL_CNT || syscalls[frame[0]].func == NULL) {
+		return;
+	}
+	sc = &syscalls[frame[0]];
+	ASSERT (sc->arg_cnt <= SYSCALL_MAX_ARGS);
+	if (!copy_from_user (frame + 1, (uint32_t*) f->esp + 1,
+	                     sc->arg_cnt * sizeof frame[0])) {
 		thread_exit ();
 	}
 
-	switch (*syscall_num) {
-	case SYS_HALT:        /* Halt the operating system. */
-		halt (f);
-		break;
-	case SYS_EXIT:        /* Terminate this process. */
-		exit (f);
-		break;
-	case SYS_EXEC:        /* Start another process. */
-		exec (f);
-		break;
-	case SYS_WAIT:        /* Wait for a child process to die. */
-		wait (f);
-		break;
-	case SYS_CREATE:      /* Create a file. */
-		create (f);
-		break;
-	case SYS_REMOVE:      /* Delete a file. */
-		remove (f);
-		break;
-	case SYS_OPEN:        /* Open a file. */
-		open (f);
-		break;
-	case SYS_FILESIZE:    /* Obtain a file's size. */
-		filesize (f);
-		break;
-	case SYS_READ:        /* Read from a file. */
-		read (f);
-		break;
-	case SYS_WRITE:       /* Write to a file. */
-		write (f);
-		break;
-	case SYS_SEEK:        /* Change position in a file. */
-		seek (f);
-		break;
-	case SYS_TELL:        /* Report current position in a file. */
-		tell (f);
-		break;
-	case SYS_CLOSE:       /* Close a file. */
-		close (f);
-		break;
-	}
-}
-
-/* Checks if a pointer is valid by making sure the pointer isn't NULL, is within the user memory, and mapped to a existing page. */
-bool
-is_valid_ptr (void* ptr) {
-	if (ptr == NULL) {
-		return false;
+	/* Per-process statistics are only touched by the process
+	   itself, so they need no locking. */
+	if (cur->syscall_stats == NULL) {
+		cur->syscall_stats = calloc (SYSCALL_CNT, sizeof * cur->syscall_stats);
+	}
+	mine = cur->syscall_stats != NULL ? &cur->syscall_stats[frame[0]] : NULL;
+
+	old_level = intr_disable ();
+	sc->stats.call_cnt++;
+	intr_set_level (old_level);
+	if (mine != NULL) {
+		mine->call_cnt++;
 	}
-	if (!is_user_vaddr (ptr)) {
+
+	start = rdtsc ();
+	sc->func (f, frame + 1);
+	cycles = rdtsc () - start;
+	bucket = latency_bucket (cycles);
+
+	old_level = intr_disable ();
+	sc->stats.cycles += cycles;
+	sc->stats.hist[bucket]++;
+	intr_set_level (old_level);
+	if (mine != NULL) {
+		mine->cycles += cycles;
+		mine->hist[bucket]++;
+	}
+}
+
+/* Prints how often each system call was made by all processes,
+   how long the calls took in total, and their latency histogram
+   (a bucket N:C means C calls took about 2**N cycles). */
+void
+syscall_print_stats (void) {
+	size_t i;
+	int b;
+
+	for (i = 0; i < SYSCALL_CNT; i++) {
+		const struct syscall* sc = &syscalls[i];
+		if (sc->func == NULL || sc->stats.call_cnt == 0) {
+			continue;
+		}
+		printf ("Syscall %s: %llu calls, %llu cycles\n",
+		        sc->name, sc->stats.call_cnt, sc->stats.cycles);
+		printf ("  latency (log2 cycles):");
+		for (b = 0; b < SYSCALL_HIST_BUCKETS; b++) {
+			if (sc->stats.hist[b] != 0) {
+				printf (" %d:%u", b, sc->stats.hist[b]);
+			}
+		}
+		printf ("\n");
+	}
+}
+
+/* Reads the byte at user address UADDR into *DST.  Returns false, leaving *DST alone, if
+   the read faults.  No page tables are consulted: a kernel-mode fault lands in page_fault(),
+   which resumes at the address left in eax (label 1 here) with eax set to 0.  On success eax
+   still holds most of the label's kernel address, so it is nonzero.  UADDR must be below
+   PHYS_BASE. */
+static inline bool
+get_user (uint8_t* dst, const uint8_t* uaddr) {
+	int eax;
+	asm volatile ("movl $1f, %%eax; movb %2, %%al; movb %%al, %0; 1:"
+	              : "=m" (*dst), "=&a" (eax) : "m" (*uaddr));
+	return eax != 0;
+}
+
+/* Writes BYTE to user address UDST.  Returns false if the write faults, including writes
+   to read-only pages.  UDST must be below PHYS_BASE. */
+static inline bool
+put_user (uint8_t* udst, uint8_t byte) {
+	int eax;
+	asm volatile ("movl $1f, %%eax; movb %b2, %0; 1:"
+	              : "=m" (*udst), "=&a" (eax) : "q" (byte));
+	return eax != 0;
+}
+
+/* Returns true if the SIZE bytes at UADDR lie entirely in user memory. */
+static bool
+is_user_range (const void* uaddr, size_t size) {
+	const uint8_t* end = (const uint8_t*) uaddr + size;
+	return size == 0 || (end > (const uint8_t*) uaddr && is_user_vaddr (end - 1));
+}
+
+/* Copies SIZE bytes from user address USRC to kernel address DST, a byte at a time with
+   get_user().  Every byte goes through the fault recovery path, since a page checked once
+   may be evicted before the next access and then fail to come back.  The buffers copied
+   here are all small; bulk transfers pin the user buffer instead (see read()).  Returns
+   false if any part of the buffer is not the process's memory, in which case DST may be
+   partly written. */
+static bool
+copy_from_user (void* dst, const void* usrc, size_t size) {
+	uint8_t* d = dst;
+	const uint8_t* s = usrc;
+	size_t i;
+
+	if (!is_user_range (usrc, size)) {
 		return false;
 	}
-	if (pagedir_get_page (thread_current ()->pagedir, ptr) == NULL) {
+	for (i = 0; i < size; i++) {
+		if (!get_user (d + i, s + i)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address UDST, a byte at a time with
+   put_user(), like copy_from_user().  Returns false if any part of the buffer is not
+   writable memory of the process, in which case UDST may be partly written. */
+static bool
+copy_to_user (void* udst, const void* src, size_t size) {
+	uint8_t* d = udst;
+	const uint8_t* s = src;
+	size_t i;
+
+	if (!is_user_range (udst, size)) {
 		return false;
 	}
+	for (i = 0; i < size; i++) {
+		if (!put_user (d + i, s[i])) {
+			return false;
+		}
+	}
 	return true;
 }
 
-/* Calls shutdown_power_off which terminates the kernal. */
-void
-halt (struct intr_frame* f) {
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_HALT);
+/* Copies the null-terminated string at user address USRC into DST, which has room for SIZE
+   bytes including the null terminator.  Returns the string's length, or -1 if it runs into
+   memory the process doesn't have or doesn't fit. */
+static int
+strncpy_from_user (char* dst, const char* usrc, size_t size) {
+	size_t i;
+	for (i = 0; i < size; i++) {
+		if (!is_user_vaddr (usrc + i) || !get_user ((uint8_t*) dst + i, (const uint8_t*) usrc + i)) {
+			return -1;
+		}
+		if (dst[i] == '\0') {
+			return i;
+		}
+	}
+	return -1;
+}
 
+/* Copies the user string USTR into a new page and returns it; the caller frees it with
+   palloc_free_page().  Kills the process if the string is bad or longer than a page. */
+static char*
+get_string (const char* ustr) {
+	char* str = palloc_get_page (0);
+	if (str == NULL) {
+		thread_exit ();
+	}
+	if (strncpy_from_user (str, ustr, PGSIZE) < 0) {
+		palloc_free_page (str);
+		thread_exit ();
+	}
+	return str;
+}
+
+/* Calls shutdown_power_off which terminates the kernal. */
+static void
+halt (struct intr_frame* f UNUSED, const uint32_t* args UNUSED) {
 	shutdown_power_off ();
 }
 
 
 /* Exits a process (thread) with the given exit status. */
-void
-exit (struct intr_frame* f) {
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_EXIT);
-
-	int* exit_status = syscall_num + 1;
-	if (is_valid_ptr ((void*) exit_status)) {
-		thread_current ()->exit_status = *exit_status;
-	}
+static void
+exit (struct intr_frame* f UNUSED, const uint32_t* args) {
+	thread_current ()->exit_status = args[0];
 
 	thread_exit ();
 }
 
 /* Executes the process by forking a child process (thread) which will load the proper executable.
     Returns the PID (TID) of the child if it was loaded successfully otherwise, -1. */
-void
-exec (struct intr_frame* f) {
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_EXEC);
-
-	char** cmdline = (char**) (syscall_num + 1);
-	if (!is_valid_ptr ((void*) cmdline) ||
-	    !is_valid_ptr ((void*) *cmdline)) {
-		thread_exit ();
-	}
+static void
+exec (struct intr_frame* f, const uint32_t* args) {
+	char* cmdline = get_string ((const char*) args[0]);
 
-	int pid = process_execute (*cmdline);
+	int pid = process_execute (cmdline);
+	palloc_free_page (cmdline);
 	f->eax = thread_current ()->exec_child_success ? pid : TID_ERROR;
 }
 
 /* Causes the parent thread to wait for a specified child until it finishes it's execution and reaps a zombie child.
     Returns exit status of the reaped child.*/
-void
-wait (struct intr_frame* f) {
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_WAIT);
-
-	tid_t* child_tid = (tid_t*) (syscall_num + 1);
-	if (!is_valid_ptr ((void*) child_tid)) {
-		thread_exit ();
-	}
-
-	f->eax = process_wait (*child_tid);
+static void
+wait (struct intr_frame* f, const uint32_t* args) {
+	f->eax = process_wait ((tid_t) args[0]);
 }
 
 
 /* Creates a file given the specified size and name.
     Returns whether the creation of the file was successful or not.*/
-void
-create (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_CREATE);
-
-	char** name = (char**) (syscall_num + 1);
-	unsigned* initial_size = (unsigned*) (syscall_num + 2);
-	if (!is_valid_ptr ((void*) name) ||
-	    !is_valid_ptr ((void*) *name) ||
-	    !is_valid_ptr ((void*) initial_size)) {
-		lock_release (&thread_filesys_lock);
-		thread_exit ();
-	}
+static void
+create (struct intr_frame* f, const uint32_t* args) {
+	char* name = get_string ((const char*) args[0]);
 
-	f->eax = filesys_create (*name, *initial_size);
-	lock_release (&thread_filesys_lock);
+	f->eax = filesys_create (name, args[1]);
+	palloc_free_page (name);
 }
 
 /* Removes a file given a file name.
     Returns whether the deletion of a file is successful or not. */
-void
-remove (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_REMOVE);
-
-	char** name = (char**) (syscall_num + 1);
-	if (!is_valid_ptr ((void*) name) ||
-	    !is_valid_ptr ((void*) *name)) {
-		lock_release (&thread_filesys_lock);
-		thread_exit ();
-	}
+static void
+remove (struct intr_frame* f, const uint32_t* args) {
+	char* name = get_string ((const char*) args[0]);
 
-	f->eax = filesys_remove (*name);
-	lock_release (&thread_filesys_lock);
+	f->eax = filesys_remove (name);
+	palloc_free_page (name);
 }
 
 /* Opens a file given it's name. If the file isn't NULL, the file is placed into the
-    first open slot in open_files array within the current thread.
+    lowest unused slot of the current thread's descriptor table.
     Returns file descriptor for the newly opened file or -1 for invalid file. */
-void
-open (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_OPEN);
-
-	char** name = (char**) (syscall_num + 1);
-	if (!is_valid_ptr ((void*) name) ||
-	    !is_valid_ptr ((void*) *name)) {
-		lock_release (&thread_filesys_lock);
-		thread_exit ();
-	}
+static void
+open (struct intr_frame* f, const uint32_t* args) {
+	char* name = get_string ((const char*) args[0]);
 
-	struct file* file = filesys_open (*name);
+	struct file* file = filesys_open (name);
+	palloc_free_page (name);
 
 	if (file == NULL) {
 		f->eax = -1;
-		lock_release (&thread_filesys_lock);
 		return;
 	}
 
-	struct thread* curr = thread_current ();
-	int i;
-	for (i = 0; i < MAX_FILES; i++)
-		if (curr->open_files[i].used == 0) {
-			break;
-		}
-
-	if (i < MAX_FILES) {
-		curr->open_files[i].used = 1;
-		curr->open_files[i].file = file;
-		curr->open_files[i].fd = i + 2;
-		f->eax = curr->open_files[i].fd;
-	} else {
+	struct file_mapping* m = malloc (sizeof * m);
+	if (m == NULL) {
+		file_close (file);
 		f->eax = -1;
+		return;
 	}
+	m->file = file;
+	m->dir = NULL;
+	m->ref_cnt = 0;
 
-	lock_release (&thread_filesys_lock);
+	if (inode_is_dir (file_get_inode (file))) {
+		m->dir = dir_open (inode_reopen (file_get_inode (file)));
+	}
+
+	f->eax = -1;
+	if (!inode_is_dir (file_get_inode (file)) || m->dir != NULL) {
+		f->eax = fd_install (m, -1);
+	}
+	if (m->ref_cnt == 0) {
+		dir_close (m->dir);
+		file_close (file);
+		free (m);
+	}
 }
 
-/* Checks the size of a file given it's file descriptor by iterating thorugh the current
-    thread's open_files list. If an invalid file descriptor is given, the thread is killed.
+/* Checks the size of a file given it's file descriptor by looking it up in the current
+    thread's descriptor table. If an invalid file descriptor is given, the thread is killed.
     Returns the size of the file. */
-void
-filesize (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_FILESIZE);
-
-	int* fd = syscall_num + 1;
-	if (!is_valid_ptr ((void*) fd)) {
-		lock_release (&thread_filesys_lock);
+static void
+filesize (struct intr_frame* f, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	if (m == NULL) {
 		thread_exit ();
 	}
 
-	struct thread* curr = thread_current ();
-	int i;
-	for (i = 0; i < MAX_FILES; i++) {
-		if (curr->open_files[i].used == 1 && curr->open_files[i].fd == *fd) {
-			ASSERT (curr->open_files[i].file != NULL);
-			f->eax = file_length (curr->open_files[i].file);
-			lock_release (&thread_filesys_lock);
-			return;
-		}
-	}
-
-	/* Only reaches here in the case of an error. */
-	lock_release (&thread_filesys_lock);
-	thread_exit ();
+	f->eax = file_length (m->file);
 }
 
 /* Reads the a file given the file descriptor into a buffer of a given size.
-    Checks if the file descriptor is standard input and if it isn't, checks the current thread's open_files.
+    Checks if the file descriptor is standard input and if it isn't, checks the current thread's descriptor table.
     Returns the amount of characters read. */
-void
-read (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_READ);
-
-	int* fd = syscall_num + 1;
-	char** buffer = (char**) (syscall_num + 2);
-	unsigned* size = (unsigned*) (syscall_num + 3);
-
-	if (!is_valid_ptr ((void*) fd) ||
-	    !is_valid_ptr ((void*) buffer) ||
-	    !is_valid_ptr ((void*) *buffer) ||
-	    !is_valid_ptr ((void*) size)) {
-		lock_release (&thread_filesys_lock);
-		thread_exit ();
-	}
+static void
+read (struct intr_frame* f, const uint32_t* args) {
+	int fd = args[0];
+	char* buffer = (char*) args[1];
+	unsigned size = args[2];
+	unsigned done = 0;
 
-	if (*fd == STDIN_FILENO) {
+	if (fd == STDIN_FILENO) {
 		char c;
 		c = input_getc ();
-		memcpy(*buffer, &c, 1);
+		if (!copy_to_user (buffer, &c, 1)) {
+			thread_exit ();
+		}
 		f->eax = 1;
-		lock_release (&thread_filesys_lock);
 		return;
 	}
 
-	struct thread* curr = thread_current ();
-	int i;
-	for (i = 0; i < MAX_FILES; i++) {
-		if (curr->open_files[i].used == 1 && curr->open_files[i].fd == *fd) {
-			ASSERT (curr->open_files[i].file != NULL);
-			f->eax = file_read (curr->open_files[i].file, *buffer, *size);
-			lock_release (&thread_filesys_lock);
-			return;
-		}
+	struct file_mapping* m = find_file (fd);
+	if (m == NULL) {
+		thread_exit ();
 	}
 
-	/* Only reaches here in the case of an error. */
-	lock_release (&thread_filesys_lock);
-	thread_exit ();
+	if (m->dir != NULL) {
+		f->eax = -1;            /* Use readdir() on directories. */
+		return;
+	}
+
+	/* Pin the buffer a chunk at a time so that filling it can't
+	   fault while the file system holds its locks.  Pinning also
+	   checks that every page of it is a writable page of the
+	   process. */
+	while (done < size) {
+		char* chunk = buffer + done;
+		unsigned chunk_size = size - done < IO_CHUNK_SIZE ? size - done : IO_CHUNK_SIZE;
+		unsigned bytes;
+
+		if (!page_pin (chunk, chunk_size, true)) {
+			thread_exit ();
+		}
+		bytes = file_read (m->file, chunk, chunk_size);
+		page_unpin (chunk, chunk_size);
+		done += bytes;
+		if (bytes < chunk_size) {
+			break;
+		}
+	}
+	f->eax = done;
 }
 
 /* Writes to the file given the file descriptor to a file from a buffer.
-    Checks if the file descriptor is standard output and if it isn't, checks the current thread's open_files.
+    Checks if the file descriptor is standard output and if it isn't, checks the current thread's descriptor table.
     Returns the amount of characters written. */
-void
-write (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_WRITE);
-
-	int* fd = syscall_num + 1;
-	char** buffer = (char**) (syscall_num + 2);
-	unsigned* size = (unsigned*) (syscall_num + 3);
-
-	if (!is_valid_ptr ((void*) fd) ||
-	    !is_valid_ptr ((void*) buffer) ||
-	    !is_valid_ptr ((void*) *buffer) ||
-	    !is_valid_ptr ((void*) size)) {
-		lock_release (&thread_filesys_lock);
+static void
+write (struct intr_frame* f, const uint32_t* args) {
+	int fd = args[0];
+	const char* buffer = (const char*) args[1];
+	unsigned size = args[2];
+	struct file_mapping* m = NULL;
+	unsigned done = 0;
+
+	if (fd != STDOUT_FILENO) {
+		m = find_file (fd);
+		if (m == NULL) {
+			thread_exit ();
+		}
+		if (m->dir != NULL) {
+			f->eax = -1;            /* Directories can't be written. */
+			return;
+		}
+	}
+
+	/* Pin the buffer a chunk at a time, which checks every page of
+	   it, so that neither the console nor the file system faults
+	   while holding a lock.  Console output up to IO_CHUNK_SIZE bytes
+	   still goes out in one putbuf(). */
+	while (done < size) {
+		const char* chunk = buffer + done;
+		unsigned chunk_size = size - done < IO_CHUNK_SIZE ? size - done : IO_CHUNK_SIZE;
+		unsigned bytes;
+
+		if (!page_pin (chunk, chunk_size, false)) {
+			thread_exit ();
+		}
+		if (m == NULL) {
+			putbuf (chunk, chunk_size);
+			bytes = chunk_size;
+		} else {
+			bytes = file_write (m->file, chunk, chunk_size);
+		}
+		page_unpin (chunk, chunk_size);
+		done += bytes;
+		if (bytes < chunk_size) {
+			break;
+		}
+	}
+	f->eax = done;
+}
+
+/* Changes the next byte to be read or written in open file fd to position,
+  expressed in bytes from the beginning of the file. (Thus, a position of 0 is the file's start.) . */
+static void
+seek (struct intr_frame* f UNUSED, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	if (m == NULL) {
 		thread_exit ();
 	}
 
-	if (*fd == STDOUT_FILENO) {
-		putbuf (*buffer, *size);
-		f->eax = *size;
-		lock_release (&thread_filesys_lock);
-		return;
+	file_seek (m->file, args[1]);
+}
+
+/* Returns the position of the next byte to be read or
+   written in open file fd, expressed in bytes from the beginning of the file. */
+static void
+tell (struct intr_frame* f, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	if (m == NULL) {
+		thread_exit ();
 	}
 
-	struct thread* curr = thread_current ();
-	int i;
-	for (i = 0; i < MAX_FILES; i++) {
-		if (curr->open_files[i].used == 1 && curr->open_files[i].fd == *fd) {
-			ASSERT (curr->open_files[i].file != NULL);
-			f->eax = file_write (curr->open_files[i].file, *buffer, *size);
-			lock_release (&thread_filesys_lock);
-			return;
-		}
+	f->eax = file_tell (m->file);
+}
+
+/* Closes file descriptor fd. Exiting or terminating a process implicitly
+   closes all its open file descriptors, as if by calling this function for each one. */
+static void
+close (struct intr_frame* f UNUSED, const uint32_t* args) {
+	if (find_file (args[0]) == NULL) {
+		thread_exit ();
 	}
 
-	/* Only reaches here in the case of an error. */
-	lock_release (&thread_filesys_lock);
-	thread_exit ();
+	fd_release (args[0]);
 }
 
-/* Changes the next byte to be read or written in open file fd to position,
-  expressed in bytes from the beginning of the file. (Thus, a position of 0 is the file's start.) . */
-void
-seek (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_SEEK);
+/* Maps the file open as fd into the process's virtual address space at addr.
+    The pages are read in lazily when first touched; writes reach the file only when the
+    mapping is removed or a dirty page is evicted.  Console fds, unknown fds, empty files,
+    and unaligned or overlapping addresses all fail.  Returns the mapping id, or -1. */
+static void
+mmap (struct intr_frame* f, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	f->eax = m != NULL ? mmap_map (m->file, (void*) args[1]) : -1;
+}
 
-	int* fd = syscall_num + 1;
-	unsigned* position = (unsigned*) (syscall_num + 2);
+/* Unmaps the mapping with the given id, writing any pages the process changed back to
+    the file.  An id the process does not have is an error. */
+static void
+munmap (struct intr_frame* f UNUSED, const uint32_t* args) {
+	if (!mmap_unmap (args[0])) {
+		thread_exit ();
+	}
+}
+
+/* Changes the current working directory of the process to dir, which may be relative or
+    absolute.  Returns true if successful, false on failure. */
+static void
+chdir (struct intr_frame* f, const uint32_t* args) {
+	char* dir = get_string ((const char*) args[0]);
+
+	f->eax = filesys_chdir (dir);
+	palloc_free_page (dir);
+}
 
-	if (!is_valid_ptr ((void*) fd) ||
-	    !is_valid_ptr ((void*) position)) {
-		lock_release (&thread_filesys_lock);
+/* Creates the directory named dir, which may be relative or absolute.  Returns true if
+    successful, false if dir already exists or any directory name in dir, besides the last,
+    does not already exist. */
+static void
+mkdir (struct intr_frame* f, const uint32_t* args) {
+	char* dir = get_string ((const char*) args[0]);
+
+	f->eax = filesys_mkdir (dir);
+	palloc_free_page (dir);
+}
+
+/* Reads a directory entry from file descriptor fd, which must represent a directory, into
+    name.  "." and ".." are never returned.  Returns true if an entry was read, false if the
+    directory has no more entries or fd is not a directory. */
+static void
+readdir (struct intr_frame* f, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	if (m == NULL) {
 		thread_exit ();
 	}
 
-	struct thread* curr = thread_current ();
-	int i;
-	for (i = 0; i < MAX_FILES; i++) {
-		if (curr->open_files[i].used == 1 && curr->open_files[i].fd == *fd) {
-			ASSERT (curr->open_files[i].file != NULL);
-			file_seek (curr->open_files[i].file, *position);
-			lock_release (&thread_filesys_lock);
-			return;
-		}
+	/* Copy out after the directory is unlocked, in case the copy faults. */
+	char entry[NAME_MAX + 1];
+	f->eax = m->dir != NULL && dir_readdir (m->dir, entry);
+	if (f->eax && !copy_to_user ((char*) args[1], entry, strlen (entry) + 1)) {
+		thread_exit ();
 	}
+}
 
-	/* Only reaches here in the case of an error. */
-	lock_release (&thread_filesys_lock);
-	thread_exit ();
+/* Returns true if fd represents a directory, false if it represents an ordinary file. */
+static void
+isdir (struct intr_frame* f, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	if (m == NULL) {
+		thread_exit ();
+	}
+
+	f->eax = m->dir != NULL;
 }
 
-/* Returns the position of the next byte to be read or
-   written in open file fd, expressed in bytes from the beginning of the file. */
-void
-tell (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_TELL);
-
-	int* fd = syscall_num + 1;
-	if (!is_valid_ptr ((void*) fd)) {
-		lock_release (&thread_filesys_lock);
+/* Returns the inode number of the inode associated with fd, which may represent an ordinary
+    file or a directory. */
+static void
+inumber (struct intr_frame* f, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	if (m == NULL) {
 		thread_exit ();
 	}
 
+	f->eax = inode_get_inumber (file_get_inode (m->file));
+}
+
+/* Returns a new file descriptor, the lowest one not in use, that refers to the same open
+    file as fd and shares its file position.  Returns -1 if fd is not an open file (the
+    console descriptors can't be duplicated) or the process has too many open. */
+static void
+dup (struct intr_frame* f, const uint32_t* args) {
+	struct file_mapping* m = find_file (args[0]);
+	f->eax = m != NULL ? fd_install (m, -1) : -1;
+}
+
+/* Makes newfd refer to the same open file as oldfd, closing whatever newfd had open first.
+    If the two are equal nothing changes.  Returns newfd, or -1 if oldfd is not an open
+    file or newfd is out of range. */
+static void
+dup2 (struct intr_frame* f, const uint32_t* args) {
+	int oldfd = args[0];
+	int newfd = args[1];
+
+	struct file_mapping* m = find_file (oldfd);
+	if (m == NULL || newfd < FD_FIRST || newfd >= MAX_FILES) {
+		f->eax = -1;
+		return;
+	}
+
+	if (newfd == oldfd) {
+		f->eax = newfd;
+		return;
+	}
+	if (find_file (newfd) != NULL) {
+		fd_release (newfd);
+	}
+	f->eax = fd_install (m, newfd);
+}
+
+/* Copies the statistics for system call number into stats: the calling process's own
+    if global is false, otherwise those of all processes since boot.  Returns false if
+    there is no such system call. */
+static void
+sysstats (struct intr_frame* f, const uint32_t* args) {
+	uint32_t number = args[0];
+	bool global = args[1];
+	struct syscall_stats stats;
 	struct thread* curr = thread_current ();
-	int i;
-	for (i = 0; i < MAX_FILES; i++) {
-		if (curr->open_files[i].used == 1 && curr->open_files[i].fd == *fd) {
-			ASSERT (curr->open_files[i].file != NULL);
-			f->eax = file_tell (curr->open_files[i].file);
-			lock_release (&thread_filesys_lock);
-			return;
-		}
+
+	if (number >= SYSCALL_CNT || syscalls[number].func == NULL) {
+		f->eax = false;
+		return;
 	}
 
-	/* Only reaches here in the case of an error. */
-	lock_release (&thread_filesys_lock);
-	thread_exit ();
+	if (global) {
+		enum intr_level old_level = intr_disable ();
+		stats = syscalls[number].stats;
+		intr_set_level (old_level);
+	} else if (curr->syscall_stats != NULL) {
+		stats = curr->syscall_stats[number];
+	} else {
+		memset (&stats, 0, sizeof stats);
+	}
+	strlcpy (stats.name, syscalls[number].name, sizeof stats.name);
+
+	if (!copy_to_user ((void*) args[2], &stats, sizeof stats)) {
+		thread_exit ();
+	}
+	f->eax = true;
 }
 
-/* Closes file descriptor fd. Exiting or terminating a process implicitly
-   closes all its open file descriptors, as if by calling this function for each one. */
+/* Closes every file descriptor of the current process and frees its descriptor table and
+    system call statistics.  Called from process_exit(). */
 void
-close (struct intr_frame* f) {
-	lock_acquire (&thread_filesys_lock);
-	int* syscall_num = (int*) (f->esp);
-	ASSERT (*syscall_num == SYS_CLOSE);
-
-	int* fd = syscall_num + 1;
-	if (!is_valid_ptr ((void*) fd)) {
-		lock_release (&thread_filesys_lock);
-		thread_exit ();
+syscall_exit (void) {
+	struct thread* curr = thread_current ();
+	int fd;
+	for (fd = FD_FIRST; fd < curr->fd_cnt; fd++) {
+		if (curr->fds[fd] != NULL) {
+			fd_release (fd);
+		}
 	}
+	free (curr->fds);
+	curr->fds = NULL;
+	curr->fd_cnt = 0;
+
+	free (curr->syscall_stats);
+	curr->syscall_stats = NULL;
+}
 
+/* Returns the current thread's open file with descriptor fd, or NULL if there is none.
+    Takes constant time: the table is indexed by descriptor. */
+static struct file_mapping*
+find_file (int fd) {
 	struct thread* curr = thread_current ();
-	int i;
-	for (i = 0; i < MAX_FILES; i++) {
-		if (curr->open_files[i].used == 1 && curr->open_files[i].fd == *fd) {
-			ASSERT (curr->open_files[i].file != NULL);
-			file_close (curr->open_files[i].file);
-			curr->open_files[i].used = 0;
-			lock_release (&thread_filesys_lock);
-			return;
+	if (fd < FD_FIRST || fd >= curr->fd_cnt) {
+		return NULL;
+	}
+	return curr->fds[fd];
+}
+
+/* Stores m in the current thread's descriptor table at fd, which must be unused, or in
+    the lowest unused slot if fd is -1.  The table doubles in size when fd is past its
+    end.  Returns the descriptor, or -1 if the table is full or can't grow. */
+static int
+fd_install (struct file_mapping* m, int fd) {
+	struct thread* curr = thread_current ();
+
+	if (fd < 0) {
+		for (fd = FD_FIRST; fd < curr->fd_cnt; fd++) {
+			if (curr->fds[fd] == NULL) {
+				break;
+			}
 		}
 	}
+	if (fd >= MAX_FILES) {
+		return -1;
+	}
 
-	/* Only reaches here in the case of an error. */
-	lock_release (&thread_filesys_lock);
-	thread_exit ();
+	if (fd >= curr->fd_cnt) {
+		int cnt = curr->fd_cnt > 0 ? curr->fd_cnt : FD_TABLE_MIN;
+		struct file_mapping** fds;
+		while (cnt <= fd) {
+			cnt *= 2;
+		}
+		if (cnt > MAX_FILES) {
+			cnt = MAX_FILES;
+		}
+		fds = realloc (curr->fds, cnt * sizeof * fds);
+		if (fds == NULL) {
+			return -1;
+		}
+		memset (fds + curr->fd_cnt, 0, (cnt - curr->fd_cnt) * sizeof * fds);
+		curr->fds = fds;
+		curr->fd_cnt = cnt;
+	}
+
+	ASSERT (curr->fds[fd] == NULL);
+	curr->fds[fd] = m;
+	m->ref_cnt++;
+	return fd;
+}
+
+/* Clears descriptor fd of the current thread, closing its file once no other descriptor
+    refers to it. */
+static void
+fd_release (int fd) {
+	struct thread* curr = thread_current ();
+	struct file_mapping* m = find_file (fd);
+
+	ASSERT (m != NULL);
+	curr->fds[fd] = NULL;
+	if (--m->ref_cnt == 0) {
+		file_close (m->file);
+		dir_close (m->dir);
+		free (m);
+	}
 }
@@ -19,9 +19,14 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, in one FIFO queue per
+   priority.  Bit P of ready_mask is set if and only if
+   ready_queues[P] is nonempty, so the highest priority with a
+   ready thread is found with one find-first-set. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt;           /* Number of threads in ready_queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -36,9 +41,6 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
-/* Lock used by threads when accessing file system code. */
-struct lock thread_filesys_lock;
-
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame
   {
@@ -61,12 +63,22 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS estimate of the number of threads ready to run, averaged
+   over the past minute. */
+static fixed_t load_avg;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static void ready_push (struct thread *);
+static void set_priority (struct thread *, int priority);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_tick (struct thread *);
+static void mlfqs_decay (struct thread *, void *coef);
+static int ready_max_priority (void);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
@@ -89,11 +101,16 @@ static tid_t allocate_tid (void);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  lock_init (&thread_filesys_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  load_avg = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -137,6 +154,9 @@ thread_tick (void)
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
@@ -236,10 +256,13 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted right away, or on return from the
+   interrupt if this is an interrupt handler.  The exception is a
+   caller that had disabled interrupts itself: it may expect that
+   it can atomically unblock a thread and update other data, so
+   it must call thread_preempt() once it turns interrupts back
+   on. */
 void
 thread_unblock (struct thread *t)
 {
@@ -249,11 +272,51 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_push (t);
   t->status = THREAD_READY;
+  if (t->priority > thread_current ()->priority)
+    {
+      if (intr_context ())
+        intr_yield_on_return ();
+      else if (old_level == INTR_ON)
+        {
+          intr_set_level (old_level);
+          thread_yield ();
+          return;
+        }
+    }
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, yields on return
+   from the interrupt instead. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool preempt = ready_max_priority () > thread_current ()->priority;
+
+  intr_set_level (old_level);
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (old_level == INTR_ON)
+    thread_yield ();
+}
+
+/* Orders threads, given their ELEMs, by priority.  With
+   list_max() this picks the first of the highest-priority
+   threads on a list. */
+bool
+thread_priority_less (const struct list_elem *a, const struct list_elem *b,
+                      void* aux UNUSED)
+{
+  return list_entry (a, struct thread, elem)->priority
+         < list_entry (b, struct thread, elem)->priority;
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void)
@@ -323,7 +386,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread)
-    list_push_back (&ready_list, &cur->elem);
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -346,11 +409,89 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.
+   Ignored under the MLFQS scheduler.  Its
+   effective priority stays higher while it has a higher donation.
+   Yields if that leaves a ready thread with a higher priority. */
 void
 thread_set_priority (int new_priority)
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The MLFQS computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+  thread_preempt ();
+}
+
+/* Maximum length of a chain of lock holders that a donation is
+   passed along, to bound the work done with interrupts off. */
+#define DONATION_DEPTH 8
+
+/* Donates the running thread's priority to the holder of the
+   lock it is about to wait for, and on along the chain of
+   holders that are themselves waiting for locks, raising each
+   one whose priority is lower.  Does nothing under the MLFQS
+   scheduler.  Must be called with interrupts off and with
+   T->waiting_lock set, where T is the running thread. */
+void
+thread_donate_priority (struct thread *t)
+{
+  int priority = t->priority;
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t == thread_current ());
+
+  if (thread_mlfqs)
+    return;
+  for (depth = 0; depth < DONATION_DEPTH && t->waiting_lock != NULL; depth++)
+    {
+      t = t->waiting_lock->holder;
+      if (t == NULL || t->priority >= priority)
+        break;
+      set_priority (t, priority);
+    }
+}
+
+/* Recomputes T's priority as the highest of its base priority and
+   the priorities of the threads waiting for locks it holds.
+   Called when T releases a lock or changes its base priority.
+   Does nothing under the MLFQS, which sets priorities itself.
+   Must be called with interrupts off. */
+void
+thread_update_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct list *waiters = &list_entry (e, struct lock, elem)->semaphore.waiters;
+      if (!list_empty (waiters))
+        {
+          struct thread *w = list_entry (list_max (waiters, thread_priority_less,
+                                                   NULL),
+                                         struct thread, elem);
+          if (w->priority > priority)
+            priority = w->priority;
+        }
+    }
+  set_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -360,35 +501,51 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED)
+thread_set_nice (int nice)
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    set_priority (cur, mlfqs_priority (cur));
+  intr_set_level (old_level);
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (load_avg * 100);
+
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void)
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (thread_current ()->recent_cpu * 100);
+
+  intr_set_level (old_level);
+  return recent;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -405,6 +562,7 @@ idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
   idle_thread = thread_current ();
+  idle_thread->priority = PRI_MIN;      /* Whatever the MLFQS said. */
   sema_up (idle_started);
 
   for (;;)
@@ -474,16 +632,29 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
+  t->waiting_lock = NULL;
   t->magic = THREAD_MAGIC;
 
   t->parent = list_empty (&all_list) ? NULL : thread_current ();
+  if (t->parent != NULL)
+    {
+      t->nice = t->parent->nice;
+      t->recent_cpu = t->parent->recent_cpu;
+    }
+  if (thread_mlfqs)
+    t->priority = t->base_priority = mlfqs_priority (t);
   t->exit_status = -1;
   t->exec_file = NULL;
   list_init (&t->live_children);
   list_init (&t->zombie_children);
   sema_init (&t->exit_sema, 0);
   sema_init (&t->exec_sema, 0);
+#ifdef VM
+  list_init (&t->mmaps);
+  t->next_mapid = 0;
+#endif
   barrier ();
   if (t->parent != NULL)
     list_push_back (&t->parent->live_children, &t->child_elem);
@@ -511,10 +682,127 @@ alloc_frame (struct thread *t, size_t size)
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
+  int priority = ready_max_priority ();
+  struct list *queue;
+  struct thread *t;
+
+  if (priority < PRI_MIN)
     return idle_thread;
+
+  queue = &ready_queues[priority];
+  t = list_entry (list_pop_front (queue), struct thread, elem);
+  ready_cnt--;
+  if (list_empty (queue))
+    ready_mask &= ~((uint64_t) 1 << priority);
+  return t;
+}
+
+/* Puts T at the back of the ready queue for its priority.  Must
+   be called with interrupts off. */
+static void
+ready_push (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching ready queue if it is ready.  Must be called with
+   interrupts off. */
+static void
+set_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_READY && t != idle_thread)
+    {
+      list_remove (&t->elem);
+      ready_cnt--;
+      if (list_empty (&ready_queues[t->priority]))
+        ready_mask &= ~((uint64_t) 1 << t->priority);
+      t->priority = priority;
+      ready_push (t);
+    }
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    t->priority = priority;
+}
+
+/* Returns the priority the MLFQS gives T:
+   PRI_MAX - recent_cpu / 4 - nice * 2, clamped to the valid
+   range. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  if (priority > PRI_MAX)
+    return PRI_MAX;
+  return priority;
+}
+
+/* MLFQS bookkeeping for timer tick, with T the running thread.
+   T is charged the tick.  Once a second the load average and
+   every thread's recent_cpu and priority are recomputed; in
+   between, only T's recent_cpu changes, so only its priority is
+   recomputed, once per time slice.  Runs in an external
+   interrupt context. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  if (t != idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (timer_ticks () % TIMER_FREQ == 0)
+    {
+      int ready = ready_cnt + (t != idle_thread ? 1 : 0);
+      fixed_t coef;
+
+      load_avg = fp_div (fp_add_int (load_avg * 59, ready), fp_from_int (60));
+      coef = fp_div (2 * load_avg, fp_add_int (2 * load_avg, 1));
+      thread_foreach (mlfqs_decay, &coef);
+    }
+  else if (timer_ticks () % TIME_SLICE == 0 && t != idle_thread)
+    set_priority (t, mlfqs_priority (t));
+
+  if (ready_max_priority () > t->priority)
+    intr_yield_on_return ();
+}
+
+/* Decays T's recent_cpu by *COEF, adds its nice value, and
+   recomputes its priority.  Called once a second through
+   thread_foreach(). */
+static void
+mlfqs_decay (struct thread *t, void *coef)
+{
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*(fixed_t *) coef, t->recent_cpu),
+                              t->nice);
+  set_priority (t, mlfqs_priority (t));
+}
+
+/* Returns the highest priority of any ready thread, or
+   PRI_MIN - 1 if no thread is ready.  Must be called with
+   interrupts off. */
+static int
+ready_max_priority (void)
+{
+  uint32_t high = ready_mask >> 32;
+  uint32_t low = ready_mask;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (high != 0)
+    return 63 - __builtin_clz (high);
+  else if (low != 0)
+    return 31 - __builtin_clz (low);
+  else
+    return PRI_MIN - 1;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -539,7 +827,6 @@ thread_schedule_tail (struct thread *prev)
   struct thread *cur = running_thread ();
   struct thread *zombie;
   struct list_elem *e;
-  int i;
 
   ASSERT (intr_get_level () == INTR_OFF);
 
@@ -563,19 +850,6 @@ thread_schedule_tail (struct thread *prev)
     {
       ASSERT (prev != cur);
 
-      if (prev->exec_file != NULL)
-        file_close (prev->exec_file);
-
-      for (i = 0; i < MAX_FILES; i++)
-        {
-          if (prev->open_files[i].used == 1)
-            {
-              ASSERT (prev->open_files[i].file != NULL);
-              file_close (prev->open_files[i].file);
-            }
-        }
-
-
       struct list_elem *trav;
 
       for (trav = list_begin (&prev->live_children); trav != list_end (&prev->live_children);
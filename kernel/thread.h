@@ -2,12 +2,18 @@
 #define KERNEL_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
 #include <list.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "devices/timer.h"
+#include "kernel/fixed-point.h"
 #include "kernel/synch.h"
 #include "filesys/file.h"
 
+struct dir;
+struct syscall_stats;
+
 /* States in a thread's life cycle. */
 enum thread_status {
 	THREAD_RUNNING,     /* Running thread. */
@@ -16,22 +22,18 @@ enum thread_status {
 	THREAD_DYING        /* About to be destroyed. */
 };
 
-/* Lock used by threads when accessing file system code.
-   This variable is declared and initialized in thread.c. */
-extern struct lock thread_filesys_lock;
-
 /* Struct that represents a file mapping:
-      - contains a variable (used) to state whether an instance of
-        this struct is currently being used as a valid file mapping
       - contains a pointer to an open file (file)
-      - contains a file descriptor (fd) for the open file */
+      - contains a directory (dir) for readdir() if the file is a directory
+      - counts the file descriptors that refer to it (ref_cnt); descriptors
+        made by dup() and dup2() share one mapping, and so the file position */
 struct file_mapping {
-	uint8_t used;
 	struct file* file;
-	int fd;
+	struct dir* dir;    /* Directory opened on FILE's inode, if it is one. */
+	int ref_cnt;        /* Number of descriptors referring to this. */
 };
 
-#define MAX_FILES 128   /* Maximum amount of open files for each thread. */
+#define MAX_FILES 1024  /* File descriptors are below this. */
 
 /* Thread identifier type.
    You can redefine this to whatever type you like. */
@@ -43,6 +45,11 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the MLFQS. */
+#define NICE_MIN -20                    /* Nicest to other threads. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -107,12 +114,20 @@ struct thread {
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
 	uint8_t* stack;                     /* Saved stack pointer. */
-	int priority;                       /* Priority. */
+	int priority;                       /* Priority, including donations. */
+	int base_priority;                  /* Priority before donations. */
+	struct list held_locks;             /* Locks held, whose waiters donate. */
+	struct lock* waiting_lock;          /* Lock being waited for, or NULL. */
+	int nice;                           /* Niceness, for the MLFQS. */
+	fixed_t recent_cpu;                 /* Recent CPU use, for the MLFQS. */
 	struct list_elem allelem;           /* List element for all threads list. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
 
+	/* Owned by devices/timer.c. */
+	struct timer sleep_timer;           /* Wakes the thread from timer_sleep(). */
+
 	struct thread* parent;              /* Pointer to this thread's parent. */
 	struct list live_children;          /* List of this thread's live children. */
 	struct list zombie_children;        /* List of this thread's zombie children. */
@@ -120,10 +135,12 @@ struct thread {
 	struct semaphore exit_sema;         /* Semaphore for parent/child exit synchronization. */
 	int exit_status;                    /* This thread's exit status. */
 
-	struct file_mapping open_files[MAX_FILES];  /* An array of open files along
-                                                   with their file descriptors. */
+	struct file_mapping** fds;          /* Open files indexed by file descriptor,
+                                           NULL where unused (see syscall.c). */
+	int fd_cnt;                         /* Number of slots in fds. */
 
 	struct file* exec_file;             /* The file that this thread is executing. */
+	struct dir* cwd;                    /* Working directory, or NULL for the root. */
 	struct semaphore exec_sema;         /* Semaphore for parent/child exec synchronization. */
 	bool exec_child_success;            /* Boolean for whether the currently executing child
                                            of this thread executed successfully. */
@@ -131,6 +148,20 @@ struct thread {
 #ifdef USERPROG
 	/* Owned by kernel/process.c. */
 	uint32_t* pagedir;                  /* Page directory. */
+
+	/* Owned by kernel/syscall.c. */
+	struct syscall_stats* syscall_stats;  /* Per-call statistics, or NULL. */
+#endif
+#ifdef VM
+	/* Owned by vm/page.c. */
+	struct hash sup_page_table;         /* Supplemental page table. */
+	bool sup_page_table_ready;          /* Has sup_page_table been set up? */
+	void* user_esp;                     /* User esp at system call entry, for
+                                           stack growth on kernel faults. */
+
+	/* Owned by vm/mmap.c. */
+	struct list mmaps;                  /* Memory-mapped files. */
+	int next_mapid;                     /* Identifier for the next mapping. */
 #endif
 
 	/* Owned by thread.c. */
@@ -153,6 +184,11 @@ tid_t thread_create (const char* name, int priority, thread_func*, void*);
 
 void thread_block (void);
 void thread_unblock (struct thread*);
+void thread_preempt (void);
+bool thread_priority_less (const struct list_elem*, const struct list_elem*,
+                           void* aux);
+void thread_donate_priority (struct thread*);
+void thread_update_priority (struct thread*);
 
 struct thread* thread_current (void);
 tid_t thread_tid (void);
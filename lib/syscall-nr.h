@@ -27,7 +27,12 @@ enum {
 	SYS_MKDIR,                  /* Create a directory. */
 	SYS_READDIR,                /* Reads a directory entry. */
 	SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-	SYS_INUMBER                 /* Returns the inode number for a fd. */
+	SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+	/* Extensions. */
+	SYS_DUP,                    /* Duplicate a file descriptor. */
+	SYS_DUP2,                   /* Duplicate onto a given descriptor. */
+	SYS_STATS                   /* Report system call statistics. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_SYSCALL_STATS_H
+#define __LIB_SYSCALL_STATS_H
+
+#include <stdint.h>
+
+/* Number of latency histogram buckets.  Bucket I counts calls
+   that took from 2**I to 2**(I+1) - 1 time stamp counter cycles;
+   the last bucket also counts anything slower. */
+#define SYSCALL_HIST_BUCKETS 32
+
+/* Statistics for one system call, as reported by sysstats(). */
+struct syscall_stats {
+	char name[16];                          /* System call name. */
+	uint64_t call_cnt;                      /* Number of calls. */
+	uint64_t cycles;                        /* Total cycles spent in them. */
+	uint32_t hist[SYSCALL_HIST_BUCKETS];    /* Latency histogram. */
+};
+
+#endif /* lib/syscall-stats.h */
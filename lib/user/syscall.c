@@ -162,3 +162,18 @@ int
 inumber (int fd) {
 	return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+dup (int fd) {
+	return syscall1 (SYS_DUP, fd);
+}
+
+int
+dup2 (int oldfd, int newfd) {
+	return syscall2 (SYS_DUP2, oldfd, newfd);
+}
+
+bool
+sysstats (int number, bool global, struct syscall_stats* stats) {
+	return syscall3 (SYS_STATS, number, global, stats);
+}
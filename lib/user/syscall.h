@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <syscall-stats.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +46,9 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int dup (int fd);
+int dup2 (int oldfd, int newfd);
+bool sysstats (int number, bool global, struct syscall_stats*);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,127 @@
+/* Test program for the timing wheel in devices/timer.c.
+
+   Sets one-shot and periodic timers whose expiry lies past the
+   end of level 0 of the wheel, so that they must cascade down
+   from level 1 before they run, and checks that each one runs on
+   exactly the tick it asked for.  Also sleeps across a cascade
+   with timer_sleep().
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "kernel/interrupt.h"
+#include "kernel/synch.h"
+#include "threads/test.h"
+
+/* Delays to test, in ticks.  Each timer is added on the last
+   tick of a level 0 revolution, so every delay crosses a level 1
+   boundary, and those over 64 start out in level 1 and have to
+   cascade down before they run. */
+static const int64_t delays[] = {1, 63, 64, 65, 100, 127, 128, 129, 200};
+
+/* Number of runs of the periodic timer. */
+#define PERIODIC_RUNS 3
+
+/* A timer that records when it ran. */
+struct probe {
+	struct timer timer;         /* The timer under test. */
+	int64_t ran[PERIODIC_RUNS]; /* Ticks at which it ran. */
+	int run_cnt;                /* Number of runs so far. */
+	int max_runs;               /* Cancel after this many runs. */
+	struct semaphore done;      /* Upped after the last run. */
+};
+
+static void probe_run (void*);
+static int64_t probe_start (struct probe*, int64_t ticks, int64_t period,
+                            int max_runs);
+static void align_to_slot_end (void);
+
+/* Test the timing wheel. */
+void
+test (void) {
+	struct probe p;
+	int64_t start;
+	size_t i;
+	int run;
+
+	printf ("testing one-shot timers:");
+	for (i = 0; i < sizeof delays / sizeof *delays; i++) {
+		printf (" %"PRId64, delays[i]);
+
+		/* Start just before a level 0 wraparound so the expiry
+		   is in a later level 1 slot. */
+		align_to_slot_end ();
+		start = probe_start (&p, delays[i], 0, 1);
+		sema_down (&p.done);
+		ASSERT (p.run_cnt == 1);
+		ASSERT (p.ran[0] == start + delays[i]);
+		ASSERT (!timer_cancel (&p.timer));
+	}
+	printf (" done\n");
+
+	printf ("testing periodic timer:");
+	align_to_slot_end ();
+	start = probe_start (&p, 10, 70, PERIODIC_RUNS);
+	sema_down (&p.done);
+	for (run = 0; run < PERIODIC_RUNS; run++) {
+		printf (" %"PRId64, p.ran[run] - start);
+		ASSERT (p.ran[run] == start + 10 + 70 * run);
+	}
+	ASSERT (!timer_cancel (&p.timer));
+	printf (" done\n");
+
+	printf ("testing timer_sleep across a cascade:");
+	align_to_slot_end ();
+	start = timer_ticks ();
+	timer_sleep (100);
+	ASSERT (timer_elapsed (start) >= 100);
+	printf (" done\n");
+
+	printf ("timer: PASS\n");
+}
+
+/* Timer callback: records the current tick in probe P, and
+   cancels the timer and wakes the test after the last run. */
+static void
+probe_run (void* p_) {
+	struct probe* p = p_;
+
+	p->ran[p->run_cnt++] = timer_ticks ();
+	if (p->run_cnt == p->max_runs) {
+		timer_cancel (&p->timer);
+		sema_up (&p->done);
+	}
+}
+
+/* Starts P's timer to run TICKS from now and then every PERIOD
+   ticks, MAX_RUNS times in all.  Returns the tick the timer was
+   added on. */
+static int64_t
+probe_start (struct probe* p, int64_t ticks, int64_t period, int max_runs) {
+	enum intr_level old_level = intr_disable ();
+	int64_t start = timer_ticks ();
+
+	ASSERT (max_runs <= PERIODIC_RUNS);
+	p->run_cnt = 0;
+	p->max_runs = max_runs;
+	sema_init (&p->done, 0);
+	p->timer.pending = false;
+	timer_add (&p->timer, ticks, period, probe_run, p);
+	intr_set_level (old_level);
+	return start;
+}
+
+/* Waits until the current tick is the last one of a level 0
+   revolution of the wheel. */
+static void
+align_to_slot_end (void) {
+	while (timer_ticks () % 64 != 63) {
+		timer_sleep (1);
+	}
+}
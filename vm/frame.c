@@ -1,136 +1,232 @@
 #include "vm/frame.h"
 #include <debug.h>
+#include <string.h>
+#include "kernel/pagedir.h"
 #include "kernel/palloc.h"
+#include "kernel/synch.h"
 #include "kernel/vaddr.h"
-#include <stdio.h>
-#include "page.h"
-#include "kernel/loader.h"
-#include "kernel/exception.h"
 #include "kernel/malloc.h"
-#include "lib/random.h"
-
+#include "filesys/file.h"
+#include "vm/swap.h"
+
+static struct frame* frametable;  /* One entry per user pool page. */
+static size_t frame_cnt;          /* Number of entries in frametable. */
+static uint8_t* user_base;        /* Kernel address of the first user page. */
+static size_t clock_hand;         /* Next frame the eviction clock looks at. */
+static struct lock frame_lock;    /* Guards frame ownership and the clock hand. */
+static struct condition evicted;  /* Signaled when a page's eviction is done. */
+static size_t evicting_cnt;       /* Pages being written out by evict_frame(). */
+
+static void set_page_as_free(struct frame* f);
+static void wait_for_eviction(struct page_entry* page);
+
+/* preptable, as the name suggests, preps the frame table.  It asks palloc
+   how big the user pool really is and allocates one entry per page, so
+   every user frame is usable by the VM.  Must run after palloc_init()
+   and malloc_init(). */
+
+void preptable(void){
+  size_t i;
+  lock_init(&frame_lock);
+  cond_init(&evicted);
+  evicting_cnt=0;
+  clock_hand=0;
+  palloc_get_user_pool((void**) &user_base,&frame_cnt);
+  frametable=malloc(sizeof *frametable * frame_cnt);
+  if(frametable==NULL)
+    PANIC("NOT ENOUGH MEMORY FOR FRAME TABLE");
+  for(i=0;i<frame_cnt;i++){
+    frametable[i].kpage=user_base+i*PGSIZE;
+    frametable[i].owner=NULL;
+    frametable[i].page=NULL;
+  }
+}
 
-int frameserved;
+/* frame_lookup returns the frame table entry for KPAGE, which must be a
+   page from the user pool.  This is O(1): the entry's index is just the
+   page's offset from the start of the pool. */
 
-/* preptable, as the name suggests, preps the frame table by initializing each value in each cell
-   in the frame array to -1, signifying the slot is empty.*/
+struct frame* frame_lookup(void* kpage){
+  size_t index=pg_no(kpage)-pg_no(user_base);
+  ASSERT(pg_ofs(kpage)==0);
+  ASSERT(index<frame_cnt);
+  return &frametable[index];
+}
 
-void preptable(size_t page_limit_t){
-  frameserved=0;
-  int i;
-  for(i=0;i<16;i++){
-    lookuptable[i]=~0;
-    //printf("%d\n",lookuptable[i]);
-  }
-  page_limit=383;
-  frametable=malloc(sizeof(fte)*10);
-  for(i=0;i<5;i++){
-    frametable[i].id=-1;
-    frametable[i].virtualAddress=-1;
+/* acquire_user_page takes the current process's page table entry PAGE and a value saying if
+   you want the frame zeroed out or not, and returns a frame for it.  If the user pool is
+   exhausted a frame is evicted and handed out instead.  Returns NULL if there is no frame to
+   evict either, because every frame is pinned or still being loaded.  The frame isn't a
+   candidate for eviction until it is mapped at PAGE's user address.  If PAGE itself is
+   being evicted, waits for that to finish, so PAGE is stable once this returns. */
+
+void* acquire_user_page(struct page_entry* page, bool zero){
+  struct frame* f;
+  void* kpage=palloc_get_page(zero ? PAL_USER|PAL_ZERO : PAL_USER);
+  lock_acquire(&frame_lock);
+  if(kpage!=NULL)
+    f=frame_lookup(kpage);
+  else{
+    size_t i=evict_frame();
+    if(i==FRAME_NONE){
+      lock_release(&frame_lock);
+      return NULL;
+    }
+    f=&frametable[i];
+    if(zero)
+      memset(f->kpage,0,PGSIZE);
   }
+  f->owner=thread_current();
+  f->page=page;
+  wait_for_eviction(page);
+  lock_release(&frame_lock);
+  return f->kpage;
 }
 
-/* f_find_empty_spot parses the entire frame table, looking for the first empty spot it comes across.
-   It returns the array location of the first available empty spot. */
+/* free_user_page takes a kernel virtual address from the user pool and frees the page at that location */
 
-int f_find_empty_spot(tid_t id){
-  int i;
-  int t;
-  /*for(i=0;i<16;i++){
+void free_user_page(void* page){
+  lock_acquire(&frame_lock);
+  set_page_as_free(frame_lookup(page));
+  lock_release(&frame_lock);
+  palloc_free_page(page);
+}
 
-    t= __builtin_ffsl(lookuptable[i]);
-    if(t!=0){
-      lookuptable[i]=lookuptable[i]&(~(1<<(t-1)));
-      return i*32+t-1;
-    }
-    //printf("%d\n",t);
+/* unload_user_page takes a page table entry of the current process and, if the page is
+   resident, unmaps it and frees its frame.  A dirty memory-mapped page is written back to
+   its file first, without frame_lock; once unmapped, the frame is no candidate for eviction
+   and only this thread touches PAGE. */
+
+void unload_user_page(struct page_entry* page){
+  struct thread* t=thread_current();
+  void* kpage;
+
+  lock_acquire(&frame_lock);
+  wait_for_eviction(page);
+  if(page->location!=PAGE_FRAME){
+    lock_release(&frame_lock);
+    return;
   }
-  */
-  for(i=0;i<10;i++){
-    if(frametable[i].id==-1) // the id == -1 is testing to find an empty slot with id of -1
-      return i;
+  kpage=page->kpage;
+  pagedir_clear_page(t->pagedir,page->upage);
+  if(page->mmap
+     && (pagedir_is_dirty(t->pagedir,page->upage) || pagedir_is_dirty(t->pagedir,kpage))){
+    lock_release(&frame_lock);
+    file_write_at(page->file,kpage,page->read_bytes,page->ofs);
+    lock_acquire(&frame_lock);
   }
-  //printf("%d\n",t);
-  //page_fault();
-  //return page_fault_handler(id);
-  //PANIC("NO FREE FRAME");
-  return page_fault_handler(id); // if there are no more free spots in the frame table, page faults
+  page->location=page->swap_slot!=SWAP_NONE ? PAGE_SWAP : page->file!=NULL ? PAGE_FILE : PAGE_ZERO;
+  page->kpage=NULL;
+  set_page_as_free(frame_lookup(kpage));
+  lock_release(&frame_lock);
+  palloc_free_page(kpage);
 }
 
-/* acquire_user_page takes the thread id, a value saying if you want the page zeroed out or not, and
-   an int stack that says if it's a stack page or not, with 1 being true.*/
+/* pin_user_page sets whether PAGE is pinned.  The evictor never picks a pinned page, so once
+   a pinned page is resident it stays resident.  An eviction of PAGE already under way is
+   waited out first, so the caller sees where the page really is. */
 
-void* acquire_user_page(tid_t id, int zero, int stack){
-  int index = f_find_empty_spot(id);
-  frameserved+=1;
-  if(zero==1)
-    frametable[index].virtualAddress=palloc_get_page(PAL_USER);
-  else
-    frametable[index].virtualAddress=palloc_get_page(PAL_USER|PAL_ZERO);
+void pin_user_page(struct page_entry* page,bool pinned){
+  lock_acquire(&frame_lock);
+  wait_for_eviction(page);
+  page->pinned=pinned;
+  lock_release(&frame_lock);
+}
 
-    frametable[index].id=id;
-  //printf("SERVeING FRAME NUMBER %d\n",frameserved);
+/* sets the given frame table entry to free */
 
-  add_entry(index,id,4|stack);
-  //in process need to replace line 526 and 486 at least
-  return frametable[index].virtualAddress;
+static void set_page_as_free(struct frame* f){
+  f->owner=NULL;
+  f->page=NULL;
 }
 
-/* free_user_page takes a virtual address and frees the page at that location */
-
-void free_user_page(void* page){
-  int i;
-  for(i=0;i<page_limit;i++){
-    if(frametable[i].virtualAddress==page){
-      set_page_as_free(i); // function that says a page at i in the array is free
-      palloc_free_page(page);
-      return;
-    }
+/* wipe_thread_pages takes a thread T and sets every frame it owns to free.  The pages
+   themselves are released by pagedir_destroy().  Pages of T that another thread is evicting
+   are waited for, since the evictor still uses their entries and files. */
+
+void wipe_thread_pages(struct thread* t){
+  size_t i;
+  lock_acquire(&frame_lock);
+  for(i=0;i<frame_cnt;i++){
+    if(frametable[i].owner==t)
+      wait_for_eviction(frametable[i].page);
+    if(frametable[i].owner==t)
+      set_page_as_free(&frametable[i]);
   }
-  //Call function for a page that is not found.
-  //page fault
+  lock_release(&frame_lock);
 }
 
-/* sets the page at a given int 'index' in the array to free */
+/* Waits until PAGE is not being evicted.  frame_lock must be held. */
 
-void set_page_as_free(int index){
-  int LUT_offset= index%32;
-  int LUT_index= index/32;
-  lookuptable[LUT_index]=lookuptable[LUT_index]|(1<<LUT_offset);
-  frametable[index].virtualAddress=-1;
-  frametable[index].id=-1;
+static void wait_for_eviction(struct page_entry* page){
+  ASSERT(lock_held_by_current_thread(&frame_lock));
+  while(page->evicting)
+    cond_wait(&evicted,&frame_lock);
 }
 
-/* wipe_thread_pages takes a thread id 'id' and sets the given page location to free, as
-   well as frees the thread id, allowing it subsequent uses. */
-
-void wipe_thread_pages(tid_t id){
-  int t = (int) id;
-  int i;
-  free_thread_id(id);
-  for(i=0;i<page_limit;i++){
-    if(frametable[i].id==t){
-        //printf("FREED PAGE ADDRESS %d\n",*(int*)frametable[i].virtualAddress);
-        //palloc_free_page(frametable[i].virtualAddress);
-        set_page_as_free(i);
+/* evict_frame picks a victim with the clock (second chance) algorithm and returns its index
+   in the frame table.  The hand sweeps the table in order; a frame whose accessed bit is set
+   gets the bit cleared and is passed over once, so only frames that have not been touched
+   for a full revolution are evicted.  The victim is unmapped from its owner and, only if it
+   is dirty through either the user or the kernel alias, written to swap, or back to its file
+   for a memory-mapped page; a clean page is just dropped, since its swap slot, file or zero
+   fill still has the same contents.  Frames that are not yet mapped at their user page
+   (still being loaded), pinned pages and pages already being evicted are never chosen.
+
+   Must be called with frame_lock held.  The lock is dropped for the write, so that faults
+   and pins elsewhere don't wait behind the disk; the victim is marked evicting meanwhile,
+   and its owner waits in acquire_user_page(), pin_user_page(), unload_user_page() or
+   wipe_thread_pages() until the write is done and its entry updated.  Two full turns of the
+   hand clear every accessed bit, so if they find no victim every frame is free, pinned,
+   loading or being evicted.  If some are being evicted, evict_frame waits for one of those
+   evictions and tries again; otherwise it returns FRAME_NONE rather than spin. */
+
+size_t evict_frame(void){
+  ASSERT(lock_held_by_current_thread(&frame_lock));
+  for(;;){
+    size_t turns;
+    for(turns=0;turns<2*frame_cnt;turns++){
+      size_t i=clock_hand;
+      struct frame* f=&frametable[i];
+      struct page_entry* p=f->page;
+      uint32_t* pd;
+      clock_hand=(clock_hand+1)%frame_cnt;
+
+      if(f->owner==NULL || f->owner->pagedir==NULL || p->pinned || p->evicting)
+        continue;
+      pd=f->owner->pagedir;
+      if(pagedir_get_page(pd,p->upage)!=f->kpage)
+        continue;
+      if(pagedir_is_accessed(pd,p->upage)){
+        pagedir_set_accessed(pd,p->upage,false); // second chance
+        continue;
+      }
+
+      /* Unmap first so the owner faults instead of writing behind our back. */
+      pagedir_clear_page(pd,p->upage);
+      if(pagedir_is_dirty(pd,p->upage) || pagedir_is_dirty(pd,f->kpage)){
+        pagedir_set_dirty(pd,f->kpage,false);
+        if(!p->mmap && p->swap_slot==SWAP_NONE)
+          p->swap_slot=alloc_swap_slot();
+        p->evicting=true;
+        evicting_cnt++;
+        lock_release(&frame_lock);
+        if(p->mmap)
+          file_write_at(p->file,f->kpage,p->read_bytes,p->ofs);
+        else
+          write_page_to_swap(p->swap_slot,f->kpage);
+        lock_acquire(&frame_lock);
+        p->evicting=false;
+        evicting_cnt--;
+        cond_broadcast(&evicted,&frame_lock);
+      }
+      p->location=p->swap_slot!=SWAP_NONE ? PAGE_SWAP : p->file!=NULL ? PAGE_FILE : PAGE_ZERO;
+      p->kpage=NULL;
+      set_page_as_free(f);
+      return i;
     }
+    if(evicting_cnt==0)
+      return FRAME_NONE;
+    cond_wait(&evicted,&frame_lock);
   }
 }
-
-/* our page fault handler that gets called when there's a page fault */
-
-int page_fault_handler(tid_t id){
-  //select random filled page
-  random_init(0);
-  int loop=0;
-  int i;
-  while(loop==0){
-    i =random_ulong()%5;
-    if(frametable[i].id!=-1)
-      loop=1;
-  }
-  //printf("PAGE FAULT!!!!!VIRTUAL ADDRESS %d : %d : %d \n",frametable[i].virtualAddress,frametable[i].id,vtop(frametable[i].virtualAddress));
-  //write that page to swap
-  write_page_to_swap(frametable[i].virtualAddress,id);
-  return i;
-}
@@ -1,26 +1,32 @@
 #ifndef FRAME_H
 #define FRAME_H
 
-#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include "kernel/thread.h"
-#include "kernel/loader.h"
+#include "vm/page.h"
 
-int lookuptable[16];
-typedef struct {
-  void* virtualAddress;
-  int id;
-}fte; // frame table entry, has a virtual address and a unique id
+/* A frame table entry.  There is exactly one of these for each page
+   in the user pool, in the same order as the pool itself, so the
+   entry for a kernel virtual address is found by pointer arithmetic
+   instead of by searching the table. */
+struct frame {
+  void* kpage;              /* Kernel virtual address of the frame. */
+  struct thread* owner;     /* Thread that owns the frame, NULL if it is free. */
+  struct page_entry* page;  /* Owner's page table entry for the frame. */
+};
 
-fte* frametable;
-int page_limit;
+/* evict_frame() value meaning "no frame could be evicted". */
+#define FRAME_NONE ((size_t) -1)
 
 // preps the functions
-void preptable(size_t page_limit);
-int f_find_empty_spot(tid_t id);
-void* acquire_user_page(tid_t id,int zero,int stack);
+void preptable(void);
+struct frame* frame_lookup(void* kpage);
+void* acquire_user_page(struct page_entry* page,bool zero);
 void free_user_page(void* page);
-void set_page_as_free(int index);
-void wipe_thread_pages(tid_t id);
-int page_fault_handler(tid_t id);
+void unload_user_page(struct page_entry* page);
+void pin_user_page(struct page_entry* page,bool pinned);
+void wipe_thread_pages(struct thread* t);
+size_t evict_frame(void);
 
 #endif
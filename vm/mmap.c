@@ -0,0 +1,99 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <round.h>
+#include "kernel/malloc.h"
+#include "kernel/thread.h"
+#include "kernel/vaddr.h"
+#include "vm/page.h"
+
+static void unmap_region(struct mmap_region* m,size_t page_cnt);
+
+/* mmap_map maps the whole of FILE into the current process's address space starting at user
+   page ADDR and returns the new mapping's id, or -1 on failure.  Pages are only recorded in
+   the supplemental page table; each is read from the file the first time it is touched.
+   Fails if the file is empty, if ADDR is null or not page aligned, or if any page of the
+   range is already in use. */
+
+int mmap_map(struct file* file,void* addr){
+  struct thread* t=thread_current();
+  struct mmap_region* m;
+  off_t length=file_length(file);
+  size_t page_cnt,i;
+
+  if(length==0 || addr==NULL || pg_ofs(addr)!=0)
+    return -1;
+  page_cnt=DIV_ROUND_UP(length,PGSIZE);
+  if(!is_user_vaddr((uint8_t*) addr+page_cnt*PGSIZE-1)
+     || (uint8_t*) addr+page_cnt*PGSIZE<(uint8_t*) addr)
+    return -1;
+  for(i=0;i<page_cnt;i++)
+    if(page_lookup(t,(uint8_t*) addr+i*PGSIZE)!=NULL)
+      return -1;
+
+  m=malloc(sizeof *m);
+  if(m==NULL)
+    return -1;
+  m->file=file_reopen(file);
+  if(m->file==NULL){
+    free(m);
+    return -1;
+  }
+  m->base=addr;
+  for(i=0;i<page_cnt;i++){
+    off_t ofs=i*PGSIZE;
+    size_t read_bytes=length-ofs<PGSIZE ? length-ofs : PGSIZE;
+    struct page_entry* p=page_add_file((uint8_t*) addr+ofs,m->file,ofs,read_bytes,true);
+    if(p==NULL){
+      unmap_region(m,i);
+      return -1;
+    }
+    p->mmap=true;
+  }
+  m->page_cnt=page_cnt;
+  m->id=t->next_mapid++;
+  list_push_back(&t->mmaps,&m->elem);
+  return m->id;
+}
+
+/* mmap_unmap removes mapping ID of the current process, writing its dirty pages back to the
+   file.  Returns false if the process has no such mapping. */
+
+bool mmap_unmap(int id){
+  struct thread* t=thread_current();
+  struct list_elem* e;
+
+  for(e=list_begin(&t->mmaps);e!=list_end(&t->mmaps);e=list_next(e)){
+    struct mmap_region* m=list_entry(e,struct mmap_region,elem);
+    if(m->id==id){
+      list_remove(e);
+      unmap_region(m,m->page_cnt);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* mmap_unmap_all removes every mapping of the current process, as if by munmap().  Called
+   when the process exits. */
+
+void mmap_unmap_all(void){
+  struct thread* t=thread_current();
+
+  while(!list_empty(&t->mmaps)){
+    struct mmap_region* m=list_entry(list_pop_front(&t->mmaps),struct mmap_region,elem);
+    unmap_region(m,m->page_cnt);
+  }
+}
+
+/* Drops the first PAGE_CNT pages of M from the current process, writing dirty ones back,
+   then closes M's file and frees M. */
+
+static void unmap_region(struct mmap_region* m,size_t page_cnt){
+  struct thread* t=thread_current();
+  size_t i;
+
+  for(i=0;i<page_cnt;i++)
+    page_remove(page_lookup(t,(uint8_t*) m->base+i*PGSIZE));
+  file_close(m->file);
+  free(m);
+}
@@ -0,0 +1,21 @@
+#ifndef MMAP_H
+#define MMAP_H
+
+#include <list.h>
+#include <stddef.h>
+#include "filesys/file.h"
+
+/* A memory-mapped file region of a process. */
+struct mmap_region {
+  int id;                     /* Mapping identifier returned by mmap(). */
+  struct file* file;          /* Private reopened handle on the file. */
+  void* base;                 /* First user page of the mapping. */
+  size_t page_cnt;            /* Number of pages mapped. */
+  struct list_elem elem;      /* Element in thread's mmaps list. */
+};
+
+int mmap_map(struct file* file,void* addr);
+bool mmap_unmap(int id);
+void mmap_unmap_all(void);
+
+#endif
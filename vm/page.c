@@ -1,52 +1,267 @@
-#include "page.h"
+#include "vm/page.h"
 #include <debug.h>
-#include "kernel/palloc.h"
+#include <string.h>
+#include "filesys/file.h"
+#include "kernel/malloc.h"
+#include "kernel/pagedir.h"
 #include "kernel/vaddr.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
 
-/* preppagetable gets run at startup and preps the page table sup_page_table, meaning it
-   sets each item in each page table entry to -1, signifying they're empty. */
+/* How far below the user stack pointer an access may land and still count as a push.
+   PUSHA stores 32 bytes below esp before it moves esp. */
+#define STACK_SLOP 32
 
-void preppagetable(){
-  int i;
-  for(i=0;i<512;i++){
-    sup_page_table[i].attr=-1;
-    sup_page_table[i].location=-1;
-    sup_page_table[i].id=-1;
+/* Largest user stack, in pages.  Set with the -stk kernel option. */
+size_t stack_page_limit=STACK_MAX_PAGES;
+
+static unsigned page_hash(const struct hash_elem* e,void* aux);
+static bool page_less(const struct hash_elem* a,const struct hash_elem* b,void* aux);
+static void page_free_entry(struct hash_elem* e,void* aux);
+static struct page_entry* page_add(void* upage,bool writable);
+
+/* page_table_init sets up T's supplemental page table, a hash of page_entry keyed by user
+   page.  Returns false if memory runs out. */
+
+bool page_table_init(struct thread* t){
+  t->sup_page_table_ready=hash_init(&t->sup_page_table,page_hash,page_less,NULL);
+  return t->sup_page_table_ready;
+}
+
+/* page_table_destroy frees every entry in T's supplemental page table along with any swap
+   slots they hold.  The frames themselves must already have been released with
+   wipe_thread_pages().  Does nothing if page_table_init() never succeeded for T, as when a
+   load fails early. */
+
+void page_table_destroy(struct thread* t){
+  if(!t->sup_page_table_ready)
+    return;
+  hash_destroy(&t->sup_page_table,page_free_entry);
+  t->sup_page_table_ready=false;
+}
+
+/* page_lookup returns T's entry for the page containing UPAGE, or NULL if T has none. */
+
+struct page_entry* page_lookup(struct thread* t,const void* upage){
+  struct page_entry key;
+  struct hash_elem* e;
+  key.upage=pg_round_down(upage);
+  e=hash_find(&t->sup_page_table,&key.elem);
+  return e!=NULL ? hash_entry(e,struct page_entry,elem) : NULL;
+}
+
+/* page_add_file records that UPAGE of the current process is backed by READ_BYTES bytes
+   of FILE starting at OFS, followed by zeros.  Nothing is read until the page is loaded.
+   Returns the new entry, or NULL if UPAGE already has one or memory runs out. */
+
+struct page_entry* page_add_file(void* upage,struct file* file,off_t ofs,
+                                 size_t read_bytes,bool writable){
+  struct page_entry* p=page_add(upage,writable);
+  if(p!=NULL){
+    p->location=PAGE_FILE;
+    p->file=file;
+    p->ofs=ofs;
+    p->read_bytes=read_bytes;
   }
+  return p;
 }
 
-/* p_find_empty_slot parses the entire page array and looks for the first empty slot,
-   then returns its location in the array. If there aren't any more empty slots, it panics the kernel. */
+/* page_add_zero records that UPAGE of the current process starts out all zeros, like a
+   bss or stack page.  Returns the new entry, or NULL if UPAGE already has one or memory
+   runs out. */
 
-int p_find_empty_slot(){
-    int i;
-    for(i=0;i<512;i++){
-      if(sup_page_table[i].attr==-1)
-        return i;
-    }
-    PANIC("NO EMPTY SUPPLEMENTAL PAGE TABLE SLOT"); // no more empty slots
+struct page_entry* page_add_zero(void* upage,bool writable,bool stack){
+  struct page_entry* p=page_add(upage,writable);
+  if(p!=NULL)
+    p->stack=stack;
+  return p;
 }
 
-/* add_entry takes an int 'location', a thread id 'id', and a char 'attr', and adds the given values
-   to the next empty slot in the page table, found by calling p_find_empty_slot. */
+/* page_load brings the page containing UPAGE of the current process into a frame and maps
+   it, reading it from its file or from swap, or zero-filling it, as its entry says.
+   Returns false if the process has no such page, no frame can be had, or the read fails. */
 
-void add_entry(int location,tid_t id,char attr){
-  int i=p_find_empty_slot();
-  sup_page_table[i].attr=attr;
-  sup_page_table[i].location=location;
-  sup_page_table[i].id=id;
+bool page_load(void* upage){
+  struct thread* t=thread_current();
+  struct page_entry* p=page_lookup(t,upage);
+  void* kpage;
+
+  if(p==NULL)
+    return false;
+
+  /* P's location is only stable once acquire_user_page() has waited out any eviction of it,
+     so the frame is zeroed below, not by asking for a zeroed frame up front. */
+  kpage=acquire_user_page(p,false);
+  if(kpage==NULL)
+    return false; // every frame is pinned or loading
+  if(p->location==PAGE_FRAME){
+    free_user_page(kpage); // someone already brought it in
+    return true;
+  }
+
+  switch(p->location){
+    case PAGE_FILE:
+      {
+        off_t bytes=file_read_at(p->file,kpage,p->read_bytes,p->ofs);
+        if(bytes!=(off_t) p->read_bytes){
+          free_user_page(kpage);
+          return false;
+        }
+        memset((uint8_t*) kpage+p->read_bytes,0,PGSIZE-p->read_bytes);
+      }
+      break;
+    case PAGE_SWAP:
+      read_page_from_swap(p->swap_slot,kpage);
+      break;
+    case PAGE_ZERO:
+      memset(kpage,0,PGSIZE);
+      break;
+    default:
+      NOT_REACHED();
+  }
+
+  /* The page now matches its backing copy, so only later writes make it dirty. */
+  pagedir_set_dirty(t->pagedir,kpage,false);
+
+  p->kpage=kpage;
+  p->location=PAGE_FRAME;
+  if(!pagedir_set_page(t->pagedir,p->upage,kpage,p->writable)){
+    p->location=p->swap_slot!=SWAP_NONE ? PAGE_SWAP : p->file!=NULL ? PAGE_FILE : PAGE_ZERO;
+    p->kpage=NULL;
+    free_user_page(kpage);
+    return false;
+  }
+  return true;
+}
+
+/* page_remove takes P out of the current process's address space and frees it.  If it is
+   resident its frame is released, after writing it back to its file if it is a dirty
+   memory-mapped page. */
+
+void page_remove(struct page_entry* p){
+  struct thread* t=thread_current();
+  unload_user_page(p);
+  hash_delete(&t->sup_page_table,&p->elem);
+  page_free_entry(&p->elem,NULL);
 }
 
-/* free_thread_id takes a thread id 'id' and frees the given thread from the page table, allowing
-   use with another process. */
+/* page_pin makes every page of the current process that overlaps the SIZE bytes at UADDR
+   resident and keeps it that way until page_unpin().  System calls pin user buffers before
+   handing them to the file system, so that no page fault happens while an inode or cache lock
+   is held.  If WRITE is true the pages must be writable.  A page with no entry may be new
+   stack, judged against the user esp saved at system call entry, just as the page fault
+   handler would.  Returns false, with nothing left pinned, if some page in the range doesn't
+   belong to the process or can't be loaded. */
+
+bool page_pin(const void* uaddr,size_t size,bool write){
+  struct thread* t=thread_current();
+  uint8_t* start=pg_round_down(uaddr);
+  uint8_t* end=(uint8_t*) uaddr+size;
+  uint8_t* upage;
 
-void free_thread_id(tid_t id){
-  int i;
-  for(i=0;i<512;i++){
-    if(sup_page_table[i].id==id){
-      sup_page_table[i].id=-1;
-      sup_page_table[i].location=-1;
-      sup_page_table[i].attr=-1;
+  if(size==0)
+    return true;
+  if(end<(uint8_t*) uaddr || !is_user_vaddr(end-1))
+    return false;
+  for(upage=start;upage<end;upage+=PGSIZE){
+    struct page_entry* p=page_lookup(t,upage);
+    if(p==NULL && page_grow_stack(upage<(uint8_t*) uaddr ? (void*) uaddr : upage,t->user_esp))
+      p=page_lookup(t,upage);
+    if(p==NULL || (write && !p->writable)){
+      page_unpin(start,upage-start);
+      return false;
     }
+    pin_user_page(p,true);
+    if(p->location!=PAGE_FRAME && !page_load(upage)){
+      page_unpin(start,upage-start+PGSIZE);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* page_unpin releases the pages pinned by page_pin(UADDR, SIZE). */
+
+void page_unpin(const void* uaddr,size_t size){
+  struct thread* t=thread_current();
+  uint8_t* upage;
+
+  if(size==0)
+    return;
+  for(upage=pg_round_down(uaddr);upage<(uint8_t*) uaddr+size;upage+=PGSIZE){
+    struct page_entry* p=page_lookup(t,upage);
+    if(p!=NULL)
+      pin_user_page(p,false);
+  }
+}
+
+/* page_grow_stack decides whether FAULT_ADDR, which has no page table entry, is the current
+   process pushing onto its stack, given the user stack pointer ESP at the time of the fault.
+   If so it adds a zeroed, writable stack page there, maps it, and returns true.  The access
+   must be no more than STACK_SLOP bytes below ESP and within stack_page_limit pages of the
+   top of user memory. */
+
+bool page_grow_stack(void* fault_addr,void* esp){
+  uint8_t* addr=fault_addr;
+  void* upage=pg_round_down(fault_addr);
+
+  if(!is_user_vaddr(addr) || addr+STACK_SLOP<(uint8_t*) esp)
+    return false;
+  if((size_t) ((uint8_t*) PHYS_BASE-(uint8_t*) upage)>stack_page_limit*PGSIZE)
+    return false;
+  if(page_add_zero(upage,true,true)==NULL)
+    return false;
+  return page_load(upage);
+}
+
+/* Creates a zero-fill entry for UPAGE in the current process's table. */
+
+static struct page_entry* page_add(void* upage,bool writable){
+  struct thread* t=thread_current();
+  struct page_entry* p;
+
+  ASSERT(pg_ofs(upage)==0);
+  p=malloc(sizeof *p);
+  if(p==NULL)
+    return NULL;
+  p->upage=upage;
+  p->location=PAGE_ZERO;
+  p->writable=writable;
+  p->stack=false;
+  p->mmap=false;
+  p->pinned=false;
+  p->evicting=false;
+  p->file=NULL;
+  p->ofs=0;
+  p->read_bytes=0;
+  p->swap_slot=SWAP_NONE;
+  p->kpage=NULL;
+  if(hash_insert(&t->sup_page_table,&p->elem)!=NULL){
+    free(p);
+    return NULL;
   }
+  return p;
+}
+
+/* Hashes a page entry by its user page number. */
+
+static unsigned page_hash(const struct hash_elem* e,void* aux UNUSED){
+  const struct page_entry* p=hash_entry(e,struct page_entry,elem);
+  return hash_int((int) pg_no(p->upage));
+}
+
+/* Orders page entries by user page. */
+
+static bool page_less(const struct hash_elem* a,const struct hash_elem* b,void* aux UNUSED){
+  return hash_entry(a,struct page_entry,elem)->upage
+         < hash_entry(b,struct page_entry,elem)->upage;
+}
+
+/* Releases an entry's swap slot, if any, and frees it. */
+
+static void page_free_entry(struct hash_elem* e,void* aux UNUSED){
+  struct page_entry* p=hash_entry(e,struct page_entry,elem);
+  if(p->swap_slot!=SWAP_NONE)
+    free_swap_slot(p->swap_slot);
+  free(p);
 }
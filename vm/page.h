@@ -1,26 +1,57 @@
 #ifndef PAGE_H
 #define PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
 #include "kernel/thread.h"
-//#include "lib/kernel/vector.h"
-typedef struct {
-    /* The attributes of the attr are based on the bits flipped on or of.
-       The least sig bit represents if it is a stack page. Next bit is for
-       swap and the next is for if it is in a frame.
-       00000001 -stack page
-       00000010 -swap page
-       00000100 -frame page
-       */
-    int location;
-    tid_t id;
-    char attr;
-
-} page_entry;
-
-page_entry sup_page_table[512];
-// dynamic array of pages.
-
-void preppagetable(void);
-int p_find_empty_slot(void);
-void add_entry(int location,tid_t id,char attr);
-void free_thread_id(tid_t id);
+
+/* Where the contents of a user page currently live. */
+enum page_location {
+  PAGE_FILE,        /* Not resident; read it from FILE at OFS. */
+  PAGE_ZERO,        /* Not resident; all zeros. */
+  PAGE_SWAP,        /* Not resident; in swap slot SWAP_SLOT. */
+  PAGE_FRAME        /* Resident in frame KPAGE. */
+};
+
+/* A supplemental page table entry.  Every user page a process may
+   touch has one of these in the process's sup_page_table, keyed by
+   UPAGE, whether or not the page is currently in memory. */
+struct page_entry {
+  void* upage;                  /* User virtual page. */
+  enum page_location location;  /* Where the page's contents are. */
+  bool writable;                /* May the process write to the page? */
+  bool stack;                   /* Is this a stack page? */
+  bool mmap;                    /* Part of a memory-mapped file? */
+  bool pinned;                  /* Keep resident (see page_pin())? */
+  bool evicting;                /* Being written out by evict_frame()? */
+
+  struct file* file;            /* Backing file, or NULL. */
+  off_t ofs;                    /* Offset of the page's data in FILE. */
+  size_t read_bytes;            /* Bytes to read from FILE; the rest are zero. */
+
+  size_t swap_slot;             /* Swap slot holding a copy, or SWAP_NONE. */
+  void* kpage;                  /* Frame, if location is PAGE_FRAME. */
+
+  struct hash_elem elem;        /* Element in thread's sup_page_table. */
+};
+
+/* Default limit on the size of a user stack, in pages (8 MB). */
+#define STACK_MAX_PAGES 2048
+
+extern size_t stack_page_limit;
+
+bool page_table_init(struct thread* t);
+void page_table_destroy(struct thread* t);
+struct page_entry* page_lookup(struct thread* t,const void* upage);
+struct page_entry* page_add_file(void* upage,struct file* file,off_t ofs,
+                                 size_t read_bytes,bool writable);
+struct page_entry* page_add_zero(void* upage,bool writable,bool stack);
+bool page_load(void* upage);
+void page_remove(struct page_entry* p);
+bool page_pin(const void* uaddr,size_t size,bool write);
+void page_unpin(const void* uaddr,size_t size);
+bool page_grow_stack(void* fault_addr,void* esp);
+
 #endif
@@ -1,27 +1,17 @@
 #ifndef SWAP_H
 #define SWAP_H
 
-#include <inttypes.h>
 #include <stddef.h>
-#include "kernel/thread.h"
-#include "devices/block.h"
-
-struct block* swap_device;
-
-typedef struct {
-  tid_t id;
-  void* virtualAddress;
-} ste; // struct for swap table entries
-
-ste *swaptable;
-block_sector_t pageslots;
 
+/* Swap slot value meaning "no slot". */
+#define SWAP_NONE ((size_t) -1)
 
 // preparing the functions
 
 void prepswaptable(void);
-int find_empty_slot(void);
-void write_page_to_swap(void* virtualAddress,tid_t id);
-void read_page_from_swap(void* virtualAddress);
+size_t alloc_swap_slot(void);
+void free_swap_slot(size_t slot);
+void write_page_to_swap(size_t slot,const void* kpage);
+void read_page_from_swap(size_t slot,void* kpage);
 
 #endif